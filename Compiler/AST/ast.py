@@ -2,6 +2,7 @@
 Python implementation of Csq AST
 """
 from Compiler.Tokenizer.tokenizer import to_str,Token,TokenType,tokenize
+from Compiler import utils
 
 
 # Node Types
@@ -26,6 +27,7 @@ class NodeTypes:
     CIMPORT = 17
     CLASS = 18
     BREAK = 19
+    YIELD = 20
 
 
 # Parent AST node type
@@ -89,6 +91,7 @@ class FunDeclNode(ASTNode):
         super().__init__()
         self.identifier = ""
         self.parameters = []
+        self.generator = False
         self.type = NodeTypes.FUN_DECL
 
     def visit(self) -> str:
@@ -104,7 +107,14 @@ class FunDeclNode(ASTNode):
         else:
             pass
 
-        code += "){\n"
+        # Generators are coroutines (see Core/Runtime/iterator.h), they need
+        # their return type spelled out and can't be timed as a single call
+        if self.generator:
+            code += ") -> Cell {\n"
+        else:
+            code += "){\n"
+        if utils.profile and not self.generator:
+            code += 'CSQ_FUNCTION("' + self.identifier + '");\n'
 
         '''
         As parameters are also in terms of variables so they should also
@@ -156,25 +166,41 @@ class ForStmtNode(ASTNode):
         self.condition = ExprNode()
         self.type = NodeTypes.FOR_STMT
 
+    def split_range(self):
+        """
+        Split the condition of `for i in <start> -> <end>` into its bounds,
+        None when the loop walks a value (for x in <value>).
+        """
+        tokens = self.condition.tokens
+        depth = 0
+        for i in range(len(tokens) - 1):
+            tok = tokens[i].token
+            if tok.endswith("(") or tok in ("[", "{"):
+                depth += 1
+            elif tok in (")", "]", "}"):
+                depth -= 1
+            elif depth == 0 and tok == "-" and tokens[i + 1].token == ">":
+                return ("".join(tok.token for tok in tokens[:i]),
+                        "".join(tok.token for tok in tokens[i + 2:]))
+        return None
+
     def visit(self) -> str:
-        s =(
-            f'allocateVar("{self.iter_name}",0);' 
-            + "\n"
-        )
-        if tokenize(self.condition.tokens[0].token[5:-1])[0].type == TokenType.VALUE:
-            
-            s += f'for(int {self.iter_name}__iter = {self.condition.tokens[0].token[5:-1]};'
-            if tokenize(self.condition.tokens[3].token[5:-1])[0].type == TokenType.VALUE:
-                s += f'{self.iter_name}__iter < {self.condition.tokens[3].token[5:-1]};'
-            else:
-                s += f'{self.iter_name}__iter < {self.condition.tokens[3].token}.intVal;'
+        """
+        The loop variable is bound to its own memory cell (by index, the body
+        may grow `memory`), the bounds of a range are evaluated once and
+        values are walked by a CsqCursor (see Core/Runtime/iterator.h).
+        """
+        name = self.iter_name
+        s = f'allocateVar("{name}",0);' + "\n"
+        bounds = self.split_range()
+        if bounds is not None:
+            s += (
+                f"for(int {name}__iter = ({bounds[0]}).intVal, {name}__end = ({bounds[1]}).intVal, "
+                f"{name}__slot = int(memory.size()) - 1; {name}__iter < {name}__end; {name}__iter++)" + "{\n"
+                + f"csqBind(memory[{name}__slot], {name}__iter);" + "\n"
+            )
         else:
-            s += f'for(int {self.iter_name}__iter = {self.condition.tokens[0].token}.intVal;'
-            if Token(self.condition.tokens[3].token[5:-1]).type == TokenType.VALUE:
-                s += f'{self.iter_name}__iter < {self.condition.tokens[3].token[5:-1]};'
-            else:
-                s += f'{self.iter_name}__iter < {self.condition.tokens[3].token}.intVal;'
-        s +=  f'{self.iter_name}__iter++)' + "{\n" + f"memory[memory.size()-1] = {self.iter_name}__iter;"+ "\n"
+            s += f"for(CsqCursor {name}__cursor({self.condition.visit()}, memory.size() - 1); {name}__cursor.next();)" + "{\n"
         return s
 
 
@@ -277,7 +303,10 @@ class MethodNode(ASTNode):
         self.parameters = []
 
     def visit(self) -> str:
-        code = f'__classes__["{self.classname}"].methods["{self.identifier}"] = [](Cell args)' + "{\n" + 'allocateVar("arg", args);\n'
+        code = f'__classes__["{self.classname}"].methods["{self.identifier}"] = [](Cell args)' + "{\n"
+        if utils.profile:
+            code += f'CSQ_FUNCTION("{self.classname}.{self.identifier}");\n'
+        code += 'allocateVar("arg", args);\n'
         return code
 
 class MemberVarDeclNode(ASTNode):
@@ -306,6 +335,15 @@ class MemberVarAssignNode(ASTNode):
         result += f'__classes__["{self.identifier[0]}"].members["{self.identifier[1]}"] = {self.value.visit()}'
         return result
 
+class YieldNode(ASTNode):
+    def __init__(self):
+        super().__init__()
+        self.value = ExprNode()
+        self.type = NodeTypes.YIELD
+
+    def visit(self) -> str:
+        return "co_yield " + self.value.visit() + ";"
+
 class BreakNode(ASTNode):
     def __init__(self):
         super().__init__()
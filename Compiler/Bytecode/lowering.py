@@ -0,0 +1,784 @@
+"""
+Lowering of Csq code to the register bytecode executed by the Csq VM
+
+The statements are classified with the same checks the C++ code generator
+uses (see Compiler/Parser/parser.py) and every function gets its own frame
+of registers: parameters and variables declared with := live in registers,
+top level variables are globals shared with the functions.
+"""
+
+import os
+import struct
+
+from Compiler.AST.ast import NodeTypes
+from Compiler.Bytecode.opcodes import (BINARY_OPCODES, BYTECODE_MAGIC,
+                                       BYTECODE_VERSION, OpCode)
+from Compiler.Compiletime.error import NameError, SyntaxError
+from Compiler.Parser.parser import (get_indent_level, remove_indent,
+                                    statement_type)
+from Compiler.Tokenizer.tokenizer import Token, TokenType, to_str, tokenize
+from Compiler.utils import _curr_path
+
+# Binding power of the binary operators, higher binds tighter
+PRECEDENCE = {
+    "or": 1,
+    "and": 2,
+    "==": 4,
+    "!=": 4,
+    "<": 4,
+    "<=": 4,
+    ">": 4,
+    ">=": 4,
+    "+": 5,
+    "-": 5,
+    "*": 6,
+    "/": 6,
+    "%": 6,
+}
+
+MAX_REGISTERS = 0xFFFF
+
+
+class LoweringError(Exception):
+    """Raised with a compile time error while lowering a statement."""
+
+    def __init__(self, error):
+        super().__init__(str(error))
+        self.error = error
+
+
+class Statement:
+    """A source line together with the statements of the block it opens."""
+
+    def __init__(self, tokens, line):
+        self.tokens = tokens
+        self.line = line
+        self.body = []
+
+
+class Proto:
+    """A compiled function: its code and the size of its register frame."""
+
+    def __init__(self, name, nparams):
+        self.name = name
+        self.nparams = nparams
+        self.nregs = nparams
+        self.generator = False
+        self.code = []
+
+
+class FunctionState:
+    """Lowering state of the function whose body is being compiled."""
+
+    def __init__(self, proto, is_main):
+        self.proto = proto
+        self.is_main = is_main
+        self.locals = {}
+        self.free = 0
+        self.loops = []
+
+    def reserve(self, count=1):
+        reg = self.free
+        self.free += count
+        if self.free > MAX_REGISTERS:
+            raise LoweringError(
+                SyntaxError(0, f"function '{self.proto.name}' needs too many registers")
+            )
+        self.proto.nregs = max(self.proto.nregs, self.free)
+        return reg
+
+    def declare(self, name):
+        if name not in self.locals:
+            self.locals[name] = self.reserve()
+        return self.locals[name]
+
+
+def build_blocks(code: str) -> list:
+    """
+    Split Csq code into statements, nesting every block under the statement
+    (ending with ':') that opens it.
+
+    Args:
+        code (str): The Csq code as a string.
+
+    Returns:
+        list: The top level statements.
+    """
+    root = []
+    stack = [(-1, root)]
+    for line_no, text in enumerate(code.split("\n"), 1):
+        if text.strip() == "" or text.strip()[0] == "#":
+            continue
+        tokens = tokenize(text)
+        indent = get_indent_level(tokens)
+        tokens = remove_indent(tokens)
+        if len(tokens) == 0:
+            continue
+        while indent <= stack[-1][0]:
+            stack.pop()
+        stmt = Statement(tokens, line_no)
+        stack[-1][1].append(stmt)
+        if tokens[-1].token == ":":
+            stack.append((indent, stmt.body))
+    return root
+
+
+def contains_yield(stmts) -> bool:
+    """Whether a function body yields (nested functions excluded)."""
+    for stmt in stmts:
+        if stmt.tokens[0].token == "yield":
+            return True
+        if stmt.tokens[0].token != "def" and contains_yield(stmt.body):
+            return True
+    return False
+
+
+class ExprParser:
+    """
+    Precedence climbing parser turning the tokens of an expression into a
+    small tree of tuples:
+        ("int", v) ("float", v) ("str", v) ("name", id) ("list", items)
+        ("call", name, args) ("index", obj, idx) ("not", x) ("neg", x)
+        ("bin", op, lhs, rhs)
+    """
+
+    def __init__(self, tokens, line):
+        self.tokens = list(tokens)
+        self.pos = 0
+        self.line = line
+
+    def error(self, msg):
+        raise LoweringError(SyntaxError(self.line, msg))
+
+    def peek(self, offset=0):
+        if self.pos + offset < len(self.tokens):
+            return self.tokens[self.pos + offset]
+        return None
+
+    def expect(self, value):
+        tok = self.peek()
+        if tok is None or tok.token != value:
+            self.error(f"expected '{value}' in {to_str(self.tokens)}")
+        self.pos += 1
+
+    def parse(self):
+        if len(self.tokens) == 0:
+            self.error("expected an expression")
+        node = self.expression(1)
+        if self.pos != len(self.tokens):
+            self.error(f"unexpected token '{self.tokens[self.pos].token}'")
+        return node
+
+    def expression(self, min_prec):
+        lhs = self.unary()
+        while True:
+            tok = self.peek()
+            if tok is None:
+                break
+            # The tokenizer glues a minus to the literal after it ("x -1")
+            if tok.type == TokenType.VALUE and tok.token.startswith("-"):
+                if PRECEDENCE["-"] < min_prec:
+                    break
+                self.tokens[self.pos] = Token(tok.token[1:], TokenType.VALUE)
+                rhs = self.expression(PRECEDENCE["-"] + 1)
+                lhs = ("bin", "-", lhs, rhs)
+                continue
+            if tok.token == "^":
+                self.error("operator '^' is not supported")
+            if tok.type in (TokenType.STR, TokenType.IDENTIFIER) or tok.token not in PRECEDENCE:
+                break
+            prec = PRECEDENCE[tok.token]
+            if prec < min_prec:
+                break
+            self.pos += 1
+            rhs = self.expression(prec + 1)
+            lhs = ("bin", tok.token, lhs, rhs)
+        return lhs
+
+    def unary(self):
+        tok = self.peek()
+        if tok is not None and tok.token == "not":
+            self.pos += 1
+            return ("not", self.expression(3))
+        if tok is not None and tok.token == "-" and tok.type == TokenType.AROPERATOR:
+            self.pos += 1
+            return ("neg", self.unary())
+        return self.postfix(self.primary())
+
+    def postfix(self, node):
+        while self.peek() is not None and self.peek().token == "[":
+            self.pos += 1
+            index = self.expression(1)
+            self.expect("]")
+            node = ("index", node, index)
+        return node
+
+    def arguments(self, close):
+        args = []
+        if self.peek() is not None and self.peek().token == close:
+            self.pos += 1
+            return args
+        while True:
+            args.append(self.expression(1))
+            tok = self.peek()
+            if tok is not None and tok.token == ",":
+                self.pos += 1
+            elif tok is not None and tok.token == close:
+                self.pos += 1
+                return args
+            else:
+                self.error(f"expected ',' or '{close}' in {to_str(self.tokens)}")
+
+    def primary(self):
+        tok = self.peek()
+        if tok is None:
+            self.error("unexpected end of expression")
+        self.pos += 1
+
+        if tok.type == TokenType.VALUE:
+            nxt = self.peek()
+            if (nxt is not None and nxt.token == "." and self.peek(1) is not None
+                    and self.peek(1).type == TokenType.VALUE):
+                self.pos += 2
+                return ("float", float(tok.token + "." + self.tokens[self.pos - 1].token))
+            try:
+                value = int(tok.token)
+            except ValueError:
+                self.error(f"invalid literal '{tok.token}'")
+            if -(2**31) <= value < 2**31:
+                return ("int", value)
+            return ("float", float(value))
+
+        if tok.type == TokenType.STR:
+            return ("str", decode_string(tok.token[1:-1]))
+
+        if tok.type == TokenType.IDENTIFIER:
+            nxt = self.peek()
+            if nxt is not None and nxt.token == "(":
+                self.pos += 1
+                return ("call", tok.token, self.arguments(")"))
+            if nxt is not None and nxt.token == ".":
+                self.error("classes and members are not supported by the VM")
+            return ("name", tok.token)
+
+        if tok.token == "(":
+            node = self.expression(1)
+            self.expect(")")
+            return node
+
+        if tok.token == "{":
+            return ("list", self.arguments("}"))
+
+        self.error(f"unexpected token '{tok.token}'")
+
+
+def decode_string(text):
+    """Resolve the C style escapes a literal would get from g++."""
+    escapes = {"n": "\n", "t": "\t", "r": "\r", "0": "\0", "\\": "\\", '"': '"', "'": "'"}
+    res = ""
+    i = 0
+    while i < len(text):
+        if text[i] == "\\" and i + 1 < len(text) and text[i + 1] in escapes:
+            res += escapes[text[i + 1]]
+            i += 2
+        else:
+            res += text[i]
+            i += 1
+    return res
+
+
+def split_at(tokens, value):
+    """Split tokens at the first `value` outside of any bracket."""
+    depth = 0
+    for pos, tok in enumerate(tokens):
+        if tok.token in ("(", "[", "{"):
+            depth += 1
+        elif tok.token in (")", "]", "}"):
+            depth -= 1
+        elif depth == 0 and tok.token == value:
+            return tokens[:pos], tokens[pos + 1:]
+    return None
+
+
+def split_range(tokens):
+    """Split the '<start> -> <end>' range of a for loop."""
+    depth = 0
+    for pos, tok in enumerate(tokens[:-1]):
+        if tok.token in ("(", "[", "{"):
+            depth += 1
+        elif tok.token in (")", "]", "}"):
+            depth -= 1
+        elif depth == 0 and tok.token == "-" and tokens[pos + 1].token == ">":
+            return tokens[:pos], tokens[pos + 2:]
+    return None
+
+
+class Lowering:
+    """Lowers a whole Csq program (with its imports) to bytecode."""
+
+    def __init__(self, include_path):
+        self.include_path = include_path
+        self.errors = []
+        self.consts = []
+        self.const_index = {}
+        self.globals = []
+        self.global_index = {}
+        self.global_stores = set()
+        self.global_loads = {}
+        self.builtins = []
+        self.builtin_index = {}
+        self.protos = [Proto("main", 0)]
+        self.functions = {}
+        self.calls = []
+        self.imported = set()
+
+    """
+    Tables
+    """
+
+    def constant(self, value):
+        key = (type(value), value)
+        if key not in self.const_index:
+            self.const_index[key] = len(self.consts)
+            self.consts.append(value)
+        return self.const_index[key]
+
+    def global_slot(self, name):
+        if name not in self.global_index:
+            self.global_index[name] = len(self.globals)
+            self.globals.append(name)
+        return self.global_index[name]
+
+    def builtin(self, name):
+        if name not in self.builtin_index:
+            self.builtin_index[name] = len(self.builtins)
+            self.builtins.append(name)
+        return self.builtin_index[name]
+
+    """
+    Emission
+    """
+
+    def emit(self, fs, op, a=0, b=0, c=0, n=0):
+        fs.proto.code.append([op, n, a, b, c])
+        return len(fs.proto.code) - 1
+
+    def emit_bx(self, fs, op, a, bx):
+        bx &= 0xFFFFFFFF
+        return self.emit(fs, op, a, bx & 0xFFFF, bx >> 16)
+
+    def patch(self, fs, pc, target):
+        fs.proto.code[pc][3] = target & 0xFFFF
+        fs.proto.code[pc][4] = target >> 16
+
+    def here(self, fs):
+        return len(fs.proto.code)
+
+    def resolve(self, fs, name, line):
+        if name in fs.locals:
+            return ("local", fs.locals[name])
+        if name not in self.global_loads:
+            self.global_loads[name] = line
+        return ("global", self.global_slot(name))
+
+    def store(self, fs, name, reg):
+        if name in fs.locals:
+            if fs.locals[name] != reg:
+                self.emit(fs, OpCode.MOVE, fs.locals[name], reg)
+        else:
+            self.global_stores.add(name)
+            self.emit(fs, OpCode.SETG, reg, self.global_slot(name))
+
+    def expr_any(self, fs, node, line):
+        """Evaluate node into any register, locals are used in place."""
+        if node[0] == "name" and node[1] in fs.locals:
+            return fs.locals[node[1]]
+        reg = fs.reserve()
+        self.expr_to(fs, node, reg, line)
+        return reg
+
+    def expr_to(self, fs, node, dst, line):
+        """Evaluate node into the register dst."""
+        save = fs.free
+        kind = node[0]
+
+        if kind == "int":
+            self.emit_bx(fs, OpCode.LOADI, dst, node[1])
+        elif kind in ("float", "str"):
+            self.emit(fs, OpCode.LOADK, dst, self.constant(node[1]))
+        elif kind == "name":
+            where, slot = self.resolve(fs, node[1], line)
+            if where == "local":
+                if slot != dst:
+                    self.emit(fs, OpCode.MOVE, dst, slot)
+            else:
+                self.emit(fs, OpCode.GETG, dst, slot)
+        elif kind == "list":
+            base = fs.free
+            for item in node[1]:
+                self.expr_to(fs, item, fs.reserve(), line)
+            self.emit(fs, OpCode.LIST, dst, base, len(node[1]))
+        elif kind == "call":
+            base = fs.free
+            for arg in node[2]:
+                self.expr_to(fs, arg, fs.reserve(), line)
+            if len(node[2]) > 0xFF:
+                raise LoweringError(SyntaxError(line, f"too many arguments for '{node[1]}'"))
+            pc = self.emit(fs, OpCode.CALL, dst, 0, base, len(node[2]))
+            self.calls.append((fs.proto, pc, node[1], line))
+        elif kind == "index":
+            idx = None
+            if node[1][0] == "name" and node[1][1] not in fs.locals:
+                where, slot = self.resolve(fs, node[1][1], line)
+                idx = self.expr_any(fs, node[2], line)
+                self.emit(fs, OpCode.INDEXG, dst, slot, idx)
+            else:
+                obj = self.expr_any(fs, node[1], line)
+                idx = self.expr_any(fs, node[2], line)
+                self.emit(fs, OpCode.INDEX, dst, obj, idx)
+        elif kind == "not":
+            self.emit(fs, OpCode.NOT, dst, self.expr_any(fs, node[1], line))
+        elif kind == "neg":
+            self.emit(fs, OpCode.NEG, dst, self.expr_any(fs, node[1], line))
+        elif node[1] in ("and", "or"):
+            # Short circuit: the left operand decides whether the right runs.
+            # A local target is only written at the end, the right side may read it
+            target = dst
+            if dst in fs.locals.values():
+                dst = fs.reserve()
+            self.expr_to(fs, node[2], dst, line)
+            jump = self.emit_bx(fs, OpCode.JMPF if node[1] == "and" else OpCode.JMPT, dst, 0)
+            self.expr_to(fs, node[3], dst, line)
+            self.patch(fs, jump, self.here(fs))
+            self.emit(fs, OpCode.TRUTH, target, dst)
+        else:
+            lhs = self.expr_any(fs, node[2], line)
+            rhs = self.expr_any(fs, node[3], line)
+            self.emit(fs, BINARY_OPCODES[node[1]], dst, lhs, rhs)
+
+        fs.free = save
+
+    def expression(self, tokens, line):
+        return ExprParser(tokens, line).parse()
+
+    """
+    Statements
+    """
+
+    def collect_locals(self, stmts, fs):
+        """Give every variable declared in a function body its register."""
+        for stmt in stmts:
+            tokens = stmt.tokens
+            if len(tokens) >= 2 and tokens[0].type == TokenType.IDENTIFIER and tokens[1].token == ":=":
+                fs.declare(tokens[0].token)
+            elif tokens[0].token == "for" and len(tokens) > 1:
+                fs.declare(tokens[1].token)
+            if tokens[0].token != "def":
+                self.collect_locals(stmt.body, fs)
+
+    def lower_block(self, stmts, fs):
+        i = 0
+        while i < len(stmts):
+            save = fs.free
+            try:
+                i = self.lower_statement(stmts, i, fs)
+            except LoweringError as e:
+                if e.error.line == 0:
+                    e.error.line = stmts[i].line
+                self.errors.append(e.error)
+                i += 1
+            fs.free = save
+
+    def lower_statement(self, stmts, i, fs):
+        stmt = stmts[i]
+        tokens = stmt.tokens
+        line = stmt.line
+
+        match statement_type(list(tokens)):
+            case NodeTypes.VAR_DECL:
+                node = self.expression(tokens[2:], line)
+                name = tokens[0].token
+                if fs.is_main:
+                    reg = self.expr_any(fs, node, line)
+                    self.store(fs, name, reg)
+                else:
+                    self.expr_to(fs, node, fs.declare(name), line)
+
+            case NodeTypes.IF_STMT:
+                return self.lower_if(stmts, i, fs)
+
+            case NodeTypes.ELIF_STMT | NodeTypes.ELSE_STMT:
+                raise LoweringError(SyntaxError(line, f"'{tokens[0].token}' without a matching if"))
+
+            case NodeTypes.WHILE_STMT:
+                top = self.here(fs)
+                cond = self.expr_any(fs, self.expression(tokens[1:-1], line), line)
+                exit_jump = self.emit_bx(fs, OpCode.JMPF, cond, 0)
+                fs.loops.append([])
+                self.lower_block(stmt.body, fs)
+                self.emit_bx(fs, OpCode.JMP, 0, top)
+                self.patch(fs, exit_jump, self.here(fs))
+                for pc in fs.loops.pop():
+                    self.patch(fs, pc, self.here(fs))
+
+            case NodeTypes.FOR_STMT:
+                self.lower_for(stmt, fs)
+
+            case NodeTypes.BREAK:
+                if len(fs.loops) == 0:
+                    raise LoweringError(SyntaxError(line, "'break' outside of a loop"))
+                fs.loops[-1].append(self.emit_bx(fs, OpCode.JMP, 0, 0))
+
+            case NodeTypes.FUN_DECL:
+                self.lower_function(stmt)
+
+            case NodeTypes.YIELD:
+                if not fs.proto.generator:
+                    raise LoweringError(SyntaxError(line, "'yield' outside of a function"))
+                self.emit(fs, OpCode.YIELD, self.expr_any(fs, self.expression(tokens[1:], line), line))
+
+            case NodeTypes.RETURN:
+                # A generator is over once it returns, there is no value to give back
+                if len(tokens) == 1 or fs.proto.generator:
+                    self.emit(fs, OpCode.RET0)
+                else:
+                    self.emit(fs, OpCode.RET, self.expr_any(fs, self.expression(tokens[1:], line), line))
+
+            case NodeTypes.IMPORT:
+                self.lower_import(to_str_path(tokens[1:]), fs, line)
+
+            case NodeTypes.CIMPORT:
+                raise LoweringError(
+                    SyntaxError(line, "cimport needs native compilation, run without --run")
+                )
+
+            case NodeTypes.CLASS:
+                raise LoweringError(SyntaxError(line, "classes are not supported by the VM"))
+
+            case NodeTypes.PRINT:
+                if tokens[0].token != "print":
+                    raise LoweringError(SyntaxError(line, f"unexpected keyword '{tokens[0].token}'"))
+                self.emit(fs, OpCode.PRINT, self.expr_any(fs, self.expression(tokens[1:], line), line))
+
+            case _:
+                self.lower_assign_or_expr(tokens, fs, line)
+
+        return i + 1
+
+    def lower_assign_or_expr(self, tokens, fs, line):
+        if len(tokens) == 1 and tokens[0].token == "ignore":
+            return
+        parts = split_at(tokens, "=")
+        if parts is None:
+            self.expr_any(fs, self.expression(tokens, line), line)
+            return
+
+        target = self.expression(parts[0], line)
+        value = self.expression(parts[1], line)
+        if target[0] == "name":
+            if target[1] in fs.locals:
+                self.expr_to(fs, value, fs.locals[target[1]], line)
+            else:
+                self.store(fs, target[1], self.expr_any(fs, value, line))
+        elif target[0] == "index" and target[1][0] == "name":
+            name = target[1][1]
+            idx = self.expr_any(fs, target[2], line)
+            val = self.expr_any(fs, value, line)
+            if name in fs.locals:
+                self.emit(fs, OpCode.SETINDEX, fs.locals[name], idx, val)
+            else:
+                self.emit(fs, OpCode.SETINDEXG, self.resolve(fs, name, line)[1], idx, val)
+        else:
+            raise LoweringError(SyntaxError(line, "invalid assignment " + to_str(tokens)))
+
+    def lower_if(self, stmts, i, fs):
+        end_jumps = []
+        while True:
+            stmt = stmts[i]
+            keyword = stmt.tokens[0].token
+            if keyword == "else":
+                self.lower_block(stmt.body, fs)
+                i += 1
+                break
+
+            cond = self.expr_any(fs, self.expression(stmt.tokens[1:-1], stmt.line), stmt.line)
+            next_jump = self.emit_bx(fs, OpCode.JMPF, cond, 0)
+            self.lower_block(stmt.body, fs)
+            i += 1
+            more = i < len(stmts) and stmts[i].tokens[0].token in ("elif", "else")
+            if more:
+                end_jumps.append(self.emit_bx(fs, OpCode.JMP, 0, 0))
+            self.patch(fs, next_jump, self.here(fs))
+            if not more:
+                break
+
+        for pc in end_jumps:
+            self.patch(fs, pc, self.here(fs))
+        return i
+
+    def lower_for(self, stmt, fs):
+        tokens = stmt.tokens
+        line = stmt.line
+        if len(tokens) < 5 or tokens[1].type != TokenType.IDENTIFIER or tokens[2].token != "in":
+            raise LoweringError(SyntaxError(line, "invalid for loop " + to_str(tokens)))
+        bounds = split_range(tokens[3:-1])
+        if bounds is None:
+            self.lower_for_in(stmt, fs)
+            return
+
+        counter = fs.reserve(2)
+        self.expr_to(fs, self.expression(bounds[0], line), counter, line)
+        self.expr_to(fs, self.expression(bounds[1], line), counter + 1, line)
+        prep = self.emit_bx(fs, OpCode.FORPREP, counter, 0)
+        body = self.here(fs)
+        self.store(fs, tokens[1].token, counter)
+        fs.loops.append([])
+        self.lower_block(stmt.body, fs)
+        self.emit_bx(fs, OpCode.FORLOOP, counter, body)
+        self.patch(fs, prep, self.here(fs))
+        for pc in fs.loops.pop():
+            self.patch(fs, pc, self.here(fs))
+
+    def lower_for_in(self, stmt, fs):
+        """
+        for x in <value>: walk a compound, a range or a generator. Variables
+        are walked in place, any other value is evaluated into the loop state
+        (see ITERPREP in Core/VM/vm.h).
+        """
+        tokens = stmt.tokens
+        line = stmt.line
+        state = fs.reserve(5)
+        node = self.expression(tokens[3:-1], line)
+        if node[0] == "name":
+            where, source = self.resolve(fs, node[1], line)
+            is_global = 1 if where == "global" else 0
+        else:
+            self.expr_to(fs, node, state + 2, line)
+            source, is_global = state + 2, 0
+
+        self.emit(fs, OpCode.ITERPREP, state, source, 0, is_global)
+        top = self.emit(fs, OpCode.ITERNEXT, state, source, 0, is_global)
+        exit_jump = self.emit_bx(fs, OpCode.JMP, 0, 0)
+        self.store(fs, tokens[1].token, state + 4)
+        fs.loops.append([])
+        self.lower_block(stmt.body, fs)
+        self.emit_bx(fs, OpCode.JMP, 0, top)
+        self.patch(fs, exit_jump, self.here(fs))
+        for pc in fs.loops.pop():
+            self.patch(fs, pc, self.here(fs))
+
+    def lower_function(self, stmt):
+        tokens = stmt.tokens
+        name = tokens[1].token
+        params = [tok.token for tok in tokens[2:] if tok.type == TokenType.IDENTIFIER]
+        if name in self.functions:
+            raise LoweringError(SyntaxError(stmt.line, f"function '{name}' is already defined"))
+
+        proto = Proto(name, len(params))
+        proto.generator = contains_yield(stmt.body)
+        self.functions[name] = len(self.protos)
+        self.protos.append(proto)
+
+        fs = FunctionState(proto, False)
+        for param in params:
+            fs.declare(param)
+        self.collect_locals(stmt.body, fs)
+        self.lower_block(stmt.body, fs)
+        self.emit(fs, OpCode.RET0)
+
+    def lower_import(self, path, fs, line):
+        module = os.path.join(_curr_path, path + ".csq")
+        if not os.path.isfile(module):
+            module = os.path.join(self.include_path, "Core", "Include", "Import", path + ".csq")
+        if not os.path.isfile(module):
+            raise LoweringError(NameError(line, f"module '{path}' not found"))
+        if module in self.imported:
+            return
+        self.imported.add(module)
+        with open(module) as source:
+            self.lower_block(build_blocks(source.read()), fs)
+
+    """
+    Program
+    """
+
+    def lower(self, code: str):
+        fs = FunctionState(self.protos[0], True)
+        self.lower_block(build_blocks(code), fs)
+        self.emit(fs, OpCode.HALT)
+
+        # Calls are bound once every function is known so that functions can
+        # be used before their definition (and recursively).
+        for proto, pc, name, line in self.calls:
+            if name in self.functions:
+                callee = self.protos[self.functions[name]]
+                if callee.nparams != proto.code[pc][1]:
+                    self.errors.append(
+                        SyntaxError(line, f"'{name}' takes {callee.nparams} arguments, "
+                                          f"{proto.code[pc][1]} given")
+                    )
+                proto.code[pc][3] = self.functions[name]
+                if callee.generator:
+                    proto.code[pc][0] = OpCode.GEN
+            else:
+                proto.code[pc][0] = OpCode.BCALL
+                proto.code[pc][3] = self.builtin(name)
+
+        for name, line in self.global_loads.items():
+            if name not in self.global_stores:
+                print(NameError(line, f"undefined name {name}"))
+
+    def serialize(self) -> bytes:
+        def string(value):
+            data = value.encode("utf-8")
+            return struct.pack("<I", len(data)) + data
+
+        out = bytearray(BYTECODE_MAGIC)
+        out += struct.pack("<I", BYTECODE_VERSION)
+
+        out += struct.pack("<I", len(self.consts))
+        for value in self.consts:
+            if isinstance(value, float):
+                out += struct.pack("<Bd", 1, value)
+            else:
+                out += struct.pack("<B", 2) + string(value)
+
+        for table in (self.globals, self.builtins):
+            out += struct.pack("<I", len(table))
+            for name in table:
+                out += string(name)
+
+        out += struct.pack("<I", len(self.protos))
+        for proto in self.protos:
+            out += string(proto.name)
+            out += struct.pack("<III", proto.nparams, proto.nregs, len(proto.code))
+            for op, n, a, b, c in proto.code:
+                out += struct.pack("<BBHHH", op, n, a, b, c)
+        return bytes(out)
+
+
+def to_str_path(tokens):
+    path = ""
+    for tok in tokens:
+        path += tok.token
+    return path
+
+
+def Lower(code: str, include_path: str) -> bytes:
+    """
+    Lower Csq code into bytecode for the Csq VM.
+
+    Args:
+        code (str): The Csq code as a string.
+        include_path (str): The csq include path used to resolve imports.
+
+    Returns:
+        bytes: The serialized bytecode program.
+    """
+    lowering = Lowering(include_path)
+    lowering.lower(code)
+    if len(lowering.errors) > 0:
+        for error in lowering.errors:
+            print(error)
+        exit(1)
+    return lowering.serialize()
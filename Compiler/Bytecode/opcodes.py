@@ -0,0 +1,67 @@
+"""
+Opcodes of the Csq VM
+
+The numbering is the bytecode encoding and must be kept in sync with the
+CSQ_OPCODES list in Core/VM/opcodes.h.
+"""
+
+BYTECODE_MAGIC = b"CSQB"
+BYTECODE_VERSION = 2
+
+
+class OpCode:
+    HALT = 0
+    LOADI = 1
+    LOADK = 2
+    MOVE = 3
+    GETG = 4
+    SETG = 5
+    ADD = 6
+    SUB = 7
+    MUL = 8
+    DIV = 9
+    MOD = 10
+    EQ = 11
+    NE = 12
+    LT = 13
+    LE = 14
+    GT = 15
+    GE = 16
+    NOT = 17
+    NEG = 18
+    TRUTH = 19
+    JMP = 20
+    JMPF = 21
+    JMPT = 22
+    LIST = 23
+    INDEX = 24
+    INDEXG = 25
+    SETINDEX = 26
+    SETINDEXG = 27
+    FORPREP = 28
+    FORLOOP = 29
+    CALL = 30
+    BCALL = 31
+    RET = 32
+    RET0 = 33
+    PRINT = 34
+    ITERPREP = 35
+    ITERNEXT = 36
+    GEN = 37
+    YIELD = 38
+
+
+# Binary operators of the language and the instruction computing them
+BINARY_OPCODES = {
+    "+": OpCode.ADD,
+    "-": OpCode.SUB,
+    "*": OpCode.MUL,
+    "/": OpCode.DIV,
+    "%": OpCode.MOD,
+    "==": OpCode.EQ,
+    "!=": OpCode.NE,
+    "<": OpCode.LT,
+    "<=": OpCode.LE,
+    ">": OpCode.GT,
+    ">=": OpCode.GE,
+}
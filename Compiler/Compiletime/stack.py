@@ -34,6 +34,15 @@ def pushVariable(name:str)->None:
     var:Variable = name
     Compiletime_Objects[name] = var
 
+'''
+Functions declared with CSQ_NATIVE by the cimported modules, name -> number
+of parameters. Calls to them are checked against it.
+'''
+Native_Functions = dict({})
+
+def pushNative(name:str, arity:int)->None:
+    Native_Functions[name] = arity
+
 def in_Compiletime_Objects(name:str)->bool:
     if name != 'ignore':
         return name in Compiletime_Objects
@@ -5,17 +5,24 @@ This module contains functions for binding the parsed and visited code with C/C+
 """
 
 
-def bind(current_path, code):
+def bind(current_path, code, profile_output=None, memstats=False):
     """
     Bind the parsed and visited code with C/C++ APIs to create a complete C/C++ program.
 
     Args:
         current_path (str): The path to the current working directory.
         code (str): The code to be bound with C/C++ APIs.
+        profile_output (str): Base name of the profiler reports, enables the profiler when given.
+        memstats (bool): Enable the allocation counters, dumped when the program exits.
 
     Returns:
         str: The complete C/C++ program including necessary headers and main function.
     """
-    res = '#include "' + current_path + '/Core/Builtin/basic.h"\n\n//Code starts from here.\n'
+    res = ''
+    if profile_output is not None:
+        res += '#define CSQ_PROFILE\n#define CSQ_PROFILE_OUTPUT "' + profile_output + '"\n'
+    if memstats:
+        res += '#define CSQ_MEMSTATS\n'
+    res += '#include "' + current_path + '/Core/Builtin/basic.h"\n\n//Code starts from here.\n'
     res += 'main\n\nmemory.reserve(1000000);\n' + code + "\nfreeMemory();\n\nendmain\n"
     return res
@@ -32,4 +32,5 @@ KEYWORDS_TABLE = [
     "cimport",
     "print",
     "break",
+    "yield",
 ]
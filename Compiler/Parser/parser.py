@@ -13,11 +13,13 @@ from Compiler.Parser.parserChecker import *
 from Compiler.Parser.parserTokenToNode import *
 from Compiler.Parser import parserTokenToNode
 from Compiler.utils import error_list,_curr_path
+from Compiler import utils
 import os
+import re
 
 
 class Scope:
-    def __init__(self, level: int, of_: NodeTypes, ended: bool) -> None:
+    def __init__(self, level: int, of_: NodeTypes, ended: bool, generator: bool = False) -> None:
         """
         Initialize a scope for tracking the indentation level and type of a block.
 
@@ -25,6 +27,7 @@ class Scope:
             level (int): The indentation level of the block.
             of_ (NodeTypes): The type of node this scope belongs to.
             ended (bool): Flag indicating if the block has ended.
+            generator (bool): The block is the body of a generator function.
 
         Returns:
             None
@@ -32,6 +35,7 @@ class Scope:
         self.indent_level = level
         self.of = of_
         self.ended = ended
+        self.generator = generator
 
 
 def get_indent_level(tokens) -> int:
@@ -96,6 +100,8 @@ def statement_type(tokens) -> NodeTypes:
         return NodeTypes.RETURN
     elif is_break_stmt(tokens):
         return NodeTypes.BREAK
+    elif is_yield_stmt(tokens):
+        return NodeTypes.YIELD
     elif is_import_stmt(tokens):
         return NodeTypes.IMPORT
     elif is_cimport_stmt(tokens):
@@ -107,18 +113,63 @@ def statement_type(tokens) -> NodeTypes:
     else:
         return NodeTypes.EXPR
 
+def is_generator(code, start, indent_level) -> bool:
+    """
+    Check whether a function yields, i.e. is a generator.
+
+    Args:
+        code (list): The code lines as lists of tokens.
+        start (int): Index of the first line of the function body.
+        indent_level (int): Indentation level of the def statement.
+
+    Returns:
+        bool: True when a statement of the body (nested functions excluded) is a yield.
+    """
+    nested = None
+    for line in code[start:]:
+        if len(remove_indent(line)) == 0:
+            continue
+        level = get_indent_level(line)
+        if level <= indent_level:
+            break
+        if nested is not None and level > nested:
+            continue
+        nested = None
+        first = remove_indent(line)[0].token
+        if first == "def":
+            nested = level
+        elif first == "yield":
+            return True
+    return False
+
+def in_generator(scope_stack) -> bool:
+    """
+    Check whether the innermost function being parsed is a generator.
+
+    Args:
+        scope_stack (list): The open scopes, innermost last.
+
+    Returns:
+        bool: True when the closest enclosing function is a generator.
+    """
+    for scope in reversed(scope_stack):
+        if scope.of == NodeTypes.FUN_DECL:
+            return scope.generator
+    return False
+
 """
 Parsing units
 """
 
 
 
-def Compile(code: list) -> str:
+def Compile(code: list, source: str = "") -> str:
     """
     Compile Csq code into C/C++ code.
 
     Args:
         code (list): A list of code lines as lists of tokens.
+        source (str): Path of the compiled file, used by the profiler markers.
 
     Returns:
         str: The compiled C/C++ code as a string.
@@ -131,8 +182,14 @@ def Compile(code: list) -> str:
     active_class = ''
     # Scope properties
     scope_stack = [Scope(0, NodeTypes.UNKNOWN_NODE, 0)]
-    # line_no = 1
+    source_line = 0
     for line in code:
+        source_line += 1
+        # Blank and comment lines neither open nor close a scope
+        if len(remove_indent(line)) == 0:
+            parserTokenToNode.line_no += 1
+            continue
+
         # Get the current scope by finding indents
         indent_level = get_indent_level(line)
 
@@ -159,6 +216,7 @@ def Compile(code: list) -> str:
 
         # Removing all indentation from the stream
         line = remove_indent(line)
+        statement_start = len(code_string)
 
         match statement_type(line):
             case NodeTypes.VAR_DECL:
@@ -253,6 +311,7 @@ def Compile(code: list) -> str:
 
             case NodeTypes.FOR_STMT:
                 node = parse_ForStmt(line)
+                pushVariable(node.iter_name)
                 code_string += node.visit() + "\n"
                 scope_stack.append(Scope(indent_level + 1, NodeTypes.FOR_STMT, 0))
 
@@ -275,6 +334,15 @@ def Compile(code: list) -> str:
                     active_class = ""
                     scope_stack.append(Scope(indent_level + 1, NodeTypes.CLASS, 0))
 
+            case NodeTypes.YIELD:
+                if in_generator(scope_stack):
+                    node = parse_YieldStmt(line[1:])
+                    code_string += node.visit() + "\n"
+                else:
+                    error_list.append(
+                        SyntaxError(parserTokenToNode.line_no, "'yield' outside of a function")
+                    )
+
             case NodeTypes.BREAK:
                 #Didn't use any parsing function since there is no need of it in case of break statement
                 node = BreakNode()
@@ -289,8 +357,9 @@ def Compile(code: list) -> str:
                 else:
                     if check_FuncDecl(line)[0]:
                         node = parse_FunDecl(line)
+                        node.generator = is_generator(code, source_line, indent_level)
                         code_string += node.visit() + "\n"
-                        scope_stack.append(Scope(indent_level + 1, NodeTypes.FUN_DECL, 0))
+                        scope_stack.append(Scope(indent_level + 1, NodeTypes.FUN_DECL, 0, node.generator))
                     else:
                         error_list.append(
                             SyntaxError(
@@ -316,11 +385,15 @@ def Compile(code: list) -> str:
                     )
                     
             case NodeTypes.CIMPORT:
-                stack.hasCimport = True
                 if check_CImportStmt(line)[0]:
                     node = parse_CImportStmt(line)
-                    code_string += "\n//" + node.path + "\n" + visit_CImportNode(node) + "\n"
+                    module_code = visit_CImportNode(node)
+                    # Names stay checked when the module declares what it provides
+                    if not registerNatives(module_code):
+                        stack.hasCimport = True
+                    code_string += "\n//" + node.path + "\n" + module_code + "\n"
                 else:
+                    stack.hasCimport = True
                     error_list.append(
                         SyntaxError(
                             parserTokenToNode.line_no,
@@ -340,8 +413,12 @@ def Compile(code: list) -> str:
                         )
                     )
             case NodeTypes.RETURN:
-                node = parse_ReturnStmt(line[1:])
-                code_string += node.visit() + '\n'
+                if in_generator(scope_stack):
+                    # A generator is over once it returns, there is no value to give back
+                    code_string += "co_return;\n"
+                else:
+                    node = parse_ReturnStmt(line[1:])
+                    code_string += node.visit() + '\n'
             case _:
                 # The procedure to parse an expression is different if it's a return statement.
                 if is_return_stmt(line):
@@ -362,6 +439,8 @@ def Compile(code: list) -> str:
                                 check_Expr(line)[1]
                             )
                         )
+        if utils.profile:
+            code_string = instrument(code_string, statement_start, line, source, source_line)
         parserTokenToNode.line_no+=1
     '''
     Even if a single error is there in a code whole converted C++ code will be deformed.
@@ -377,6 +456,18 @@ def Compile(code: list) -> str:
 
 
 
+def instrument(code_string, start, line, source, source_line):
+    """
+    Place the profiler marker of a statement in front of the code generated
+    for it (see Core/Runtime/profile.h). elif/else must directly follow the
+    closing brace of the previous branch so they are left unmarked.
+    """
+    if start == len(code_string) or line[0].token in ("elif", "else"):
+        return code_string
+    marker = 'CSQ_LINE("' + source + '",' + str(source_line) + ");"
+    return code_string[:start] + marker + code_string[start:]
+
+
 def visit_ImportNode(node):
     csq_include_path = os.getenv("CSQ_INCLUDE")
     importPath = os.path.join(csq_include_path, "Core", "Include", "Import")
@@ -394,11 +485,13 @@ def visit_ImportNode(node):
     # Convert it into stream of tokens
     lines = []
     for line in code_.split("\n"):
-        if line != "":
+        if line.strip() != "":
             lines.append(tokenize(line))
+        else:
+            lines.append([])
 
     # Moving forth to compilation
-    compiled_code = Compile(lines)
+    compiled_code = Compile(lines, os.path.abspath(modulePath))
     return compiled_code
 '''
 Function to import C/C++ code on the basis of given CImportNode
@@ -419,3 +512,41 @@ def visit_CImportNode(node):
     # Read the file and process it
     code_ = module.read()
     return code_
+
+def registerNatives(code: str) -> bool:
+    """
+    Record the functions a C/C++ module declares with CSQ_NATIVE(name)(params).
+
+    Args:
+        code (str): Source of the module.
+
+    Returns:
+        bool: True if the module declares its functions this way.
+    """
+    declarations = re.findall(r"CSQ_NATIVE\((\w+)\)\s*\(([^)]*)\)", code)
+    for name, params in declarations:
+        stack.pushNative(name, 0 if params.strip() == "" else len(splitParams(params)))
+    return len(declarations) > 0
+
+def splitParams(params: str) -> list:
+    """
+    Split a C++ parameter list on the commas which aren't inside template arguments.
+
+    Args:
+        params (str): The parameter list without its parentheses.
+
+    Returns:
+        list: One string per parameter.
+    """
+    result = [""]
+    depth = 0
+    for char in params:
+        if char == "<":
+            depth += 1
+        elif char == ">":
+            depth -= 1
+        if char == "," and depth == 0:
+            result.append("")
+        else:
+            result[-1] += char
+    return result
@@ -70,6 +70,11 @@ def is_return_stmt(tokens) -> bool:
         return True
     return False
 
+def is_yield_stmt(tokens) -> bool:
+    if len(tokens) >= 1 and tokens[0].token == "yield":
+        return True
+    return False
+
 def is_break_stmt(tokens) -> bool:
     if len(tokens) >= 1 and tokens[0].token == "break":
         return True
@@ -2,10 +2,38 @@ from Compiler.AST.ast import *
 from Compiler.Compiletime.stack import Compiletime_Objects, pushVariable, in_Compiletime_Objects, Variable
 from Compiler.Compiletime import stack
 from Compiler.Compiletime import error
+from Compiler.utils import error_list
 
 
 line_no = 1
 
+def count_arguments(tokens, open_index) -> int:
+    """
+    Count the arguments of the call whose "(" is tokens[open_index].
+
+    Args:
+        tokens (list): A list of tokens representing an expression.
+        open_index (int): Index of the opening parenthesis.
+
+    Returns:
+        int: The number of arguments.
+    """
+    depth = 0
+    commas = 0
+    empty = True
+    for token in tokens[open_index + 1:]:
+        if token.token == ")" and depth == 0:
+            break
+        if token.token in ("(", "[", "{"):
+            depth += 1
+        elif token.token in (")", "]", "}"):
+            depth -= 1
+        elif token.token == "," and depth == 0:
+            commas += 1
+        empty = False
+    return 0 if empty else commas + 1
+
+
 def parse_ExprNode(tokens) -> ExprNode:
     """
     Parse an expression node from a list of tokens.
@@ -18,12 +46,45 @@ def parse_ExprNode(tokens) -> ExprNode:
     """
     node = ExprNode()
     i = 0
+    # not binds looser than the comparisons, like on the VM: its operand is
+    # closed at the next and/or/comma of the bracket depth it was opened at
+    depth = 0
+    open_nots = []
+
+    def close_nots():
+        while open_nots and open_nots[-1] == depth:
+            open_nots.pop()
+            node.tokens.append(Token(")", TokenType.BLANK))
 
     while i < len(tokens):
         current_token = tokens[i]
 
-        if current_token.type == TokenType.IDENTIFIER:
+        if current_token.token in ("and", "or", ","):
+            close_nots()
+        elif current_token.token in (")", "]", "}"):
+            close_nots()
+            depth -= 1
+        elif current_token.token in ("(", "[", "{"):
+            depth += 1
+
+        if current_token.type == TokenType.LOPERATOR:
+            if current_token.token == "not":
+                open_nots.append(depth)
+                node.tokens.append(Token("!(", TokenType.BLANK))
+            else:
+                node.tokens.append(Token("&&" if current_token.token == "and" else "||", TokenType.BLANK))
+
+        elif current_token.type == TokenType.IDENTIFIER:
             if i + 1 < len(tokens) and tokens[i + 1].token == "(":
+                depth += 1
+                if current_token.token in stack.Native_Functions:
+                    expected = stack.Native_Functions[current_token.token]
+                    given = count_arguments(tokens, i + 1)
+                    if given != expected:
+                        # Stops the compilation, g++ would only report a lambda overload mismatch
+                        error_list.append(
+                            error.TypeError(line_no, f"{current_token.token}() takes {expected} arguments, {given} given")
+                        )
                 node.tokens.append(Token(current_token.token + "(", TokenType.BLANK))
                 i += 1
             elif i + 1 < len(tokens) and tokens[i + 1].token == ".":
@@ -73,6 +134,7 @@ def parse_ExprNode(tokens) -> ExprNode:
 
         i += 1
 
+    close_nots()
     return node
 
 
@@ -200,6 +262,11 @@ def parse_ReturnStmt(tokens):
     node.value = parse_ExprNode(tokens)
     return node
 
+def parse_YieldStmt(tokens):
+    node = YieldNode()
+    node.value = parse_ExprNode(tokens)
+    return node
+
 def parse_ForStmt(tokens):
     tokens.pop(len(tokens) - 1)
 
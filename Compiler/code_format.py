@@ -31,11 +31,15 @@ def toTokens(code: str) -> list:
     tokens = []
 
     for line in code.split("\n"):
+        # Blank lines are kept so that the index of a stream is its line number
+        if line.strip() == "":
+            tokens.append([])
+            continue
         try:
             tokenStream = tokenize(line)
             tokens.append(tokenStream)
         except Exception as e:
-            pass
+            tokens.append([])
 
     tokens.append(tokenize("ignore"))
     return tokens
@@ -54,3 +58,18 @@ def writeCode(code: str, path: str) -> None:
     """
     with open(path, "w") as codefile:
         codefile.write(code)
+
+
+def writeBytecode(code: bytes, path: str) -> None:
+    """
+    Write Csq bytecode to a file.
+
+    Args:
+        code (bytes): The serialized bytecode.
+        path (str): The path to the output file where the bytecode will be written.
+
+    Returns:
+        None
+    """
+    with open(path, "wb") as codefile:
+        codefile.write(code)
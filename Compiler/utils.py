@@ -5,4 +5,8 @@ _curr_path = ''
 '''
 This list will be holding all the errors tracked during parsing
 '''
-error_list = []
\ No newline at end of file
+error_list = []
+'''
+Set when compiling with --profile, the generated code then carries the profiler markers.
+'''
+profile = False
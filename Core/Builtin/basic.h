@@ -3,6 +3,8 @@
 #include "../Runtime/memory.h"
 #include "../Runtime/core.h"
 #include "codes.h"
+#include "sort.h"
+#include "strings.h"
 #include <cmath>
 #include <algorithm>
 #include <iostream>
@@ -27,6 +29,9 @@ void print_(const Cell& cell) {
             }
             std::cout << "]\n";
             break;
+        case Type::ITERATOR:
+            std::cout << "<" << cell.iterVal->name() << ">";
+            break;
         default:
             std::cout << "Unknown type";
             break;
@@ -52,6 +57,9 @@ void print(const Cell& cell) {
             }
             std::cout << "]";
             break;
+        case Type::ITERATOR:
+            std::cout << "<" << cell.iterVal->name() << ">";
+            break;
         default:
             std::cout << "Unknown type";
             break;
@@ -80,6 +88,10 @@ Cell type(Cell val){
             return Cell("string");
             break;
         }
+        case Type::ITERATOR:{
+            return Cell(val.iterVal->name());
+            break;
+        }
         default:{
             return Cell("custype");
             break;
@@ -88,7 +100,7 @@ Cell type(Cell val){
 }
 
 Cell _push_elem(Cell ls, Cell elem){
-    ls.vectorVal->push_back(elem);
+    CSQ_MEM_TRACK(ls, ls.vectorVal->push_back(elem));
     return ls;
 }
 
@@ -97,7 +109,10 @@ Cell _pop_elem(Cell ls){
     return ls;
 }
 
-Cell len(Cell arr){
+Cell len(const Cell& arr){
+    if (arr.type == Type::STRING) {
+        return Cell(int(arr.stringVal->size()));
+    }
     return Cell(int(arr.vectorVal->size()));
 }
 
@@ -111,12 +126,9 @@ Cell object(Cell name){
 
 
 Cell input(){
-    Cell obj;
-    obj.type = Type::STRING;
     string inp;
     cin >> inp;
-    obj.stringVal = new string(inp);
-    return obj;
+    return Cell(std::move(inp));
 }
 
 //Function to return the number of memory cells allocated
@@ -124,6 +136,65 @@ Cell allocatedMemory(){
     return Cell(int(memory.size()));
 }
 
+//Function to return the allocation counters, one row per type:
+//{type, allocs, frees, bytes, copies, moves, live bytes, peak bytes}
+//The counters are only maintained by programs built or run with --memstats
+Cell memstats(){
+    vector<Cell> rows;
+    for (int t = 0; t < CSQ_MEM_TYPES; t++) {
+        const CsqMemCounters& c = csqMemCounters[t];
+        rows.push_back(Cell(vector<Cell>{Cell(string(csqMemTypeNames[t])), Cell(double(c.allocs)), Cell(double(c.frees)),
+                                         Cell(double(c.bytes)), Cell(double(c.copies)), Cell(double(c.moves)),
+                                         Cell(double(c.live)), Cell(double(c.peak))}));
+    }
+    return Cell(std::move(rows));
+}
+
+//Bound of a range, floats are truncated like the bounds of a `->` loop
+inline int rangeBound(const Cell& bound){
+    if (bound.type == Type::FLOAT) {
+        return int(bound.floatVal);
+    }
+    if (bound.type != Type::INT) {
+        printf("%s\n", string("Csq TypeError: range expects numbers").c_str());
+        return 0;
+    }
+    return bound.intVal;
+}
+
+//Lazy range start, start + step, ... up to stop (excluded), walked by for loops without building a list
+Cell range(Cell start, Cell stop, Cell step){
+    int by = rangeBound(step);
+    if (by == 0) {
+        printf("%s\n", string("Csq ValueError: range step can't be 0").c_str());
+        by = 1;
+    }
+    return Cell(new CsqRange(rangeBound(start), rangeBound(stop), by));
+}
+
+Cell range(Cell start, Cell stop){
+    return range(start, stop, Cell(1));
+}
+
+//Compound of every value of a range or generator
+Cell collect(Cell seq){
+    if (seq.type == Type::COMPOUND) {
+        return seq;
+    }
+    vector<Cell> values;
+    if (seq.type == Type::ITERATOR) {
+        CsqIterator* it = seq.iterVal->iterate();
+        Cell value;
+        while (it->next(value)) {
+            values.push_back(value);
+        }
+        if (--it->refs == 0) {
+            delete it;
+        }
+    }
+    return Cell(std::move(values));
+}
+
 //Manually delete or allocate a cell like new and delete
 void alloc(Cell mem){
     memory.push_back(mem);
@@ -0,0 +1,388 @@
+#if !defined(SORT_CSQ4)
+#define SORT_CSQ4
+
+/*
+sort(xs), sort(xs, key), argsort(xs) and argsort(xs, key) builtins.
+
+key is the index of the column to sort rows (compounds) by. The keys are
+classified once instead of switching on the type at every comparison:
+ints and floats go through an LSD radix sort on order preserving unsigned
+keys, strings and mixed lists through a stable merge sort which runs on
+several threads for large inputs. Every kernel is stable.
+
+Mixed lists are ordered numbers < strings < compounds < objects, numbers
+by value, strings and compounds lexicographically.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../Runtime/memory.h"
+
+// Below this many elements a single thread sorts
+const size_t CSQ_SORT_PARALLEL_MIN = 1 << 16;
+
+enum class CsqSortKind {
+    INT,
+    FLOAT,
+    STRING,
+    GENERIC,
+};
+
+inline int csqSortRank(const Cell& cell) {
+    switch (cell.type) {
+        case Type::INT:
+        case Type::FLOAT:
+            return 0;
+        case Type::STRING:
+            return 1;
+        case Type::COMPOUND:
+            return 2;
+        default:
+            return 3;
+    }
+}
+
+inline double csqSortNumber(const Cell& cell) {
+    return cell.type == Type::INT ? double(cell.intVal) : cell.floatVal;
+}
+
+// Total order over every type (Cell::operator< only handles numbers of the same type)
+inline bool csqSortLess(const Cell& a, const Cell& b) {
+    int rank = csqSortRank(a);
+    if (rank != csqSortRank(b)) {
+        return rank < csqSortRank(b);
+    }
+    switch (rank) {
+        case 0: {
+            if (a.type == Type::INT && b.type == Type::INT) {
+                return a.intVal < b.intVal;
+            }
+            double x = csqSortNumber(a), y = csqSortNumber(b);
+            // NaN goes last
+            return x < y || (y != y && x == x);
+        }
+        case 1:
+            return *a.stringVal < *b.stringVal;
+        case 2:
+            return lexicographical_compare(a.vectorVal->begin(), a.vectorVal->end(), b.vectorVal->begin(),
+                                           b.vectorVal->end(), csqSortLess);
+        default:
+            return false;
+    }
+}
+
+/*
+Radix keys: unsigned integers ordered like the values they encode
+*/
+
+inline uint32_t csqRadixKey(int value) {
+    return uint32_t(value) ^ 0x80000000u;
+}
+
+inline int csqRadixInt(uint32_t key) {
+    return int(key ^ 0x80000000u);
+}
+
+inline uint64_t csqRadixKey(double value) {
+    uint64_t bits;
+    if (value != value) {
+        value = NAN;
+    }
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits >> 63) ? ~bits : bits | 0x8000000000000000ull;
+}
+
+inline double csqRadixFloat(uint64_t key) {
+    uint64_t bits = (key >> 63) ? key & 0x7fffffffffffffffull : ~key;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// LSD radix sort of keys, one byte per pass, order (when given) is permuted alongside
+template <typename K>
+void csqRadixSort(vector<K>& keys, vector<uint32_t>* order) {
+    const size_t n = keys.size();
+    const int passes = sizeof(K);
+    vector<size_t> counts(passes * 256, 0);
+    for (K key : keys) {
+        for (int p = 0; p < passes; p++) {
+            counts[p * 256 + ((key >> (8 * p)) & 0xff)]++;
+        }
+    }
+
+    vector<K> keysTmp(n);
+    vector<uint32_t> orderTmp(order != nullptr ? n : 0);
+    for (int p = 0; p < passes; p++) {
+        size_t* count = &counts[p * 256];
+        // Every key has the same byte here, the pass wouldn't move anything
+        if (count[(keys[0] >> (8 * p)) & 0xff] == n) {
+            continue;
+        }
+        size_t offset = 0;
+        for (int d = 0; d < 256; d++) {
+            size_t c = count[d];
+            count[d] = offset;
+            offset += c;
+        }
+        if (order != nullptr) {
+            for (size_t i = 0; i < n; i++) {
+                size_t pos = count[(keys[i] >> (8 * p)) & 0xff]++;
+                keysTmp[pos] = keys[i];
+                orderTmp[pos] = (*order)[i];
+            }
+            order->swap(orderTmp);
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                keysTmp[count[(keys[i] >> (8 * p)) & 0xff]++] = keys[i];
+            }
+        }
+        keys.swap(keysTmp);
+    }
+}
+
+inline unsigned csqSortThreads(size_t n) {
+    if (n < CSQ_SORT_PARALLEL_MIN) {
+        return 1;
+    }
+    unsigned threads = std::thread::hardware_concurrency();
+    if (const char* env = getenv("CSQ_SORT_THREADS")) {
+        threads = unsigned(atoi(env));
+    }
+    // Keep the chunks large enough to be worth a thread
+    threads = std::min<size_t>(threads, n / (CSQ_SORT_PARALLEL_MIN / 4));
+    return threads > 0 ? threads : 1;
+}
+
+// Stable merge sort: every thread sorts a chunk, then neighbouring chunks are merged pairwise
+template <typename T, typename Less>
+void csqParallelSort(vector<T>& items, Less less) {
+    const size_t n = items.size();
+    const unsigned threads = csqSortThreads(n);
+    if (threads == 1) {
+        stable_sort(items.begin(), items.end(), less);
+        return;
+    }
+
+    vector<size_t> bounds(threads + 1);
+    for (unsigned t = 0; t <= threads; t++) {
+        bounds[t] = n * t / threads;
+    }
+    auto first = items.begin();
+    vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([=] { stable_sort(first + bounds[t], first + bounds[t + 1], less); });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    for (size_t width = 1; width < threads; width *= 2) {
+        workers.clear();
+        for (size_t t = 0; t + width < threads; t += 2 * width) {
+            size_t lo = bounds[t], mid = bounds[t + width], hi = bounds[std::min<size_t>(t + 2 * width, threads)];
+            workers.emplace_back([=] { inplace_merge(first + lo, first + mid, first + hi, less); });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+}
+
+// Key of an element: the element itself, or its column key when key >= 0
+inline const Cell& csqSortKey(const Cell& cell, int key) {
+    return key < 0 ? cell : (*cell.vectorVal)[key];
+}
+
+inline bool csqSortCheck(const Cell& list, int key) {
+    if (list.type != Type::COMPOUND) {
+        printf("%s\n", string("Csq TypeError: sort expects a compound").c_str());
+        return false;
+    }
+    if (key < 0) {
+        return true;
+    }
+    for (const Cell& row : *list.vectorVal) {
+        if (row.type != Type::COMPOUND || size_t(key) >= row.vectorVal->size()) {
+            printf("%s\n", ("Csq IndexError: sort key " + to_string(key) + " is out of range for a row").c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+inline CsqSortKind csqSortKind(const vector<Cell>& v, int key) {
+    bool ints = true, numbers = true, strings = true;
+    for (const Cell& cell : v) {
+        Type type = csqSortKey(cell, key).type;
+        ints = ints && type == Type::INT;
+        numbers = numbers && (type == Type::INT || type == Type::FLOAT);
+        strings = strings && type == Type::STRING;
+    }
+    if (ints) {
+        return CsqSortKind::INT;
+    }
+    if (numbers) {
+        return CsqSortKind::FLOAT;
+    }
+    return strings ? CsqSortKind::STRING : CsqSortKind::GENERIC;
+}
+
+// Positions of the elements of v in sorted order (lists are limited to 2^32 elements)
+inline vector<uint32_t> csqSortOrder(const vector<Cell>& v, int key) {
+    const size_t n = v.size();
+    vector<uint32_t> order(n);
+    for (size_t i = 0; i < n; i++) {
+        order[i] = uint32_t(i);
+    }
+    if (n < 2) {
+        return order;
+    }
+
+    switch (csqSortKind(v, key)) {
+        case CsqSortKind::INT: {
+            vector<uint32_t> keys(n);
+            for (size_t i = 0; i < n; i++) {
+                keys[i] = csqRadixKey(csqSortKey(v[i], key).intVal);
+            }
+            csqRadixSort(keys, &order);
+            break;
+        }
+        case CsqSortKind::FLOAT: {
+            vector<uint64_t> keys(n);
+            for (size_t i = 0; i < n; i++) {
+                keys[i] = csqRadixKey(csqSortNumber(csqSortKey(v[i], key)));
+            }
+            csqRadixSort(keys, &order);
+            break;
+        }
+        case CsqSortKind::STRING: {
+            struct Item {
+                const string* value;
+                uint32_t index;
+            };
+            vector<Item> items(n);
+            for (size_t i = 0; i < n; i++) {
+                items[i] = {csqSortKey(v[i], key).stringVal, uint32_t(i)};
+            }
+            csqParallelSort(items, [](const Item& a, const Item& b) { return *a.value < *b.value; });
+            for (size_t i = 0; i < n; i++) {
+                order[i] = items[i].index;
+            }
+            break;
+        }
+        case CsqSortKind::GENERIC: {
+            struct Item {
+                const Cell* value;
+                uint32_t index;
+            };
+            vector<Item> items(n);
+            for (size_t i = 0; i < n; i++) {
+                items[i] = {&csqSortKey(v[i], key), uint32_t(i)};
+            }
+            csqParallelSort(items, [](const Item& a, const Item& b) { return csqSortLess(*a.value, *b.value); });
+            for (size_t i = 0; i < n; i++) {
+                order[i] = items[i].index;
+            }
+            break;
+        }
+    }
+    return order;
+}
+
+inline Cell csqSort(Cell list, int key) {
+    if (!csqSortCheck(list, key)) {
+        return list;
+    }
+    vector<Cell>& v = *list.vectorVal;
+    const size_t n = v.size();
+
+    // Plain int and float lists are rebuilt from the sorted keys
+    if (key < 0 && n > 1) {
+        bool ints = true, floats = true;
+        for (const Cell& cell : v) {
+            ints = ints && cell.type == Type::INT;
+            floats = floats && cell.type == Type::FLOAT;
+        }
+        if (ints) {
+            vector<uint32_t> keys(n);
+            for (size_t i = 0; i < n; i++) {
+                keys[i] = csqRadixKey(v[i].intVal);
+            }
+            csqRadixSort(keys, nullptr);
+            for (size_t i = 0; i < n; i++) {
+                v[i].intVal = csqRadixInt(keys[i]);
+            }
+            return list;
+        }
+        if (floats) {
+            vector<uint64_t> keys(n);
+            for (size_t i = 0; i < n; i++) {
+                keys[i] = csqRadixKey(v[i].floatVal);
+            }
+            csqRadixSort(keys, nullptr);
+            for (size_t i = 0; i < n; i++) {
+                v[i].floatVal = csqRadixFloat(keys[i]);
+            }
+            return list;
+        }
+    }
+
+    vector<uint32_t> order = csqSortOrder(v, key);
+    vector<Cell> sorted;
+    sorted.reserve(n);
+    for (uint32_t i : order) {
+        sorted.push_back(std::move(v[i]));
+    }
+    v.swap(sorted);
+    return list;
+}
+
+inline Cell csqArgsort(const Cell& list, int key) {
+    if (!csqSortCheck(list, key)) {
+        return Cell(vector<Cell>());
+    }
+    vector<uint32_t> order = csqSortOrder(*list.vectorVal, key);
+    vector<Cell> indices(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        indices[i].intVal = int(order[i]);
+    }
+    return Cell(std::move(indices));
+}
+
+inline int csqSortColumn(const Cell& key) {
+    if (key.type != Type::INT || key.intVal < 0) {
+        printf("%s\n", string("Csq TypeError: sort key must be a column index").c_str());
+        return -2;
+    }
+    return key.intVal;
+}
+
+//Sorted copy of a list, sort(rows, key) sorts rows by their column key
+Cell sort(Cell list){
+    return csqSort(std::move(list), -1);
+}
+
+Cell sort(Cell list, Cell key){
+    int column = csqSortColumn(key);
+    return column < -1 ? list : csqSort(std::move(list), column);
+}
+
+//Indices which would sort a list, argsort(rows, key) sorts by column key
+Cell argsort(Cell list){
+    return csqArgsort(list, -1);
+}
+
+Cell argsort(Cell list, Cell key){
+    int column = csqSortColumn(key);
+    return column < -1 ? Cell(vector<Cell>()) : csqArgsort(list, column);
+}
+
+#endif // SORT_CSQ4
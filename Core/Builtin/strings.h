@@ -0,0 +1,248 @@
+#if !defined(STRINGS_CSQ4)
+#define STRINGS_CSQ4
+
+/*
+split, find, replace, count, strip, lower, upper and startswith builtins.
+
+Substring and separator scans go through memchr and memmem, which glibc
+implements with SSE2/AVX2 kernels chosen for the running CPU. Counting a
+byte and ASCII case mapping compare 16 bytes at a time with SSE2, which
+every x86-64 CPU has, and fall back to a byte loop elsewhere. Positions
+are byte offsets.
+
+The kernels work on string_views, csqStrSplit hands out views into the
+split string so that C++ code (see Cimport/csv.cpp) only copies the pieces
+it keeps. The builtins read their arguments by reference instead of copying
+the strings.
+*/
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "../Runtime/memory.h"
+#include "../Runtime/native.h"
+
+// Position of needle in hay at or after from, npos when absent
+inline size_t csqStrFind(string_view hay, string_view needle, size_t from = 0) {
+    if (from > hay.size()) {
+        return string_view::npos;
+    }
+    if (needle.empty()) {
+        return from;
+    }
+    const char* base = hay.data();
+    const void* hit = needle.size() == 1 ? memchr(base + from, needle[0], hay.size() - from)
+                                         : memmem(base + from, hay.size() - from, needle.data(), needle.size());
+    return hit == nullptr ? string_view::npos : size_t(static_cast<const char*>(hit) - base);
+}
+
+inline size_t csqStrCountByte(string_view s, char c) {
+    size_t n = 0, i = 0;
+#if defined(__SSE2__)
+    const __m128i needle = _mm_set1_epi8(c);
+    for (; i + 16 <= s.size(); i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s.data() + i));
+        n += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+    }
+#endif
+    for (; i < s.size(); i++) {
+        n += s[i] == c;
+    }
+    return n;
+}
+
+// Non-overlapping occurrences of needle, like Python an empty needle is found len + 1 times
+inline size_t csqStrCount(string_view s, string_view needle) {
+    if (needle.empty()) {
+        return s.size() + 1;
+    }
+    if (needle.size() == 1) {
+        return csqStrCountByte(s, needle[0]);
+    }
+    size_t n = 0;
+    for (size_t at = csqStrFind(s, needle); at != string_view::npos; at = csqStrFind(s, needle, at + needle.size())) {
+        n++;
+    }
+    return n;
+}
+
+// Calls piece(view) for every part of s between two occurrences of sep (not empty)
+template <typename Piece>
+inline void csqStrSplit(string_view s, string_view sep, Piece piece) {
+    size_t start = 0;
+    for (size_t at = csqStrFind(s, sep); at != string_view::npos; at = csqStrFind(s, sep, start)) {
+        piece(s.substr(start, at - start));
+        start = at + sep.size();
+    }
+    piece(s.substr(start));
+}
+
+inline bool csqIsSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Calls piece(view) for every run of non whitespace characters
+template <typename Piece>
+inline void csqStrSplitWords(string_view s, Piece piece) {
+    size_t i = 0;
+    while (i < s.size()) {
+        while (i < s.size() && csqIsSpace(s[i])) {
+            i++;
+        }
+        size_t start = i;
+        while (i < s.size() && !csqIsSpace(s[i])) {
+            i++;
+        }
+        if (i > start) {
+            piece(s.substr(start, i - start));
+        }
+    }
+}
+
+inline string_view csqStrStrip(string_view s) {
+    size_t begin = 0, end = s.size();
+    while (begin < end && csqIsSpace(s[begin])) {
+        begin++;
+    }
+    while (end > begin && csqIsSpace(s[end - 1])) {
+        end--;
+    }
+    return s.substr(begin, end - begin);
+}
+
+// Flips the case of the ASCII letters in [first, first + 25] of n bytes, in place
+inline void csqStrCase(char* s, size_t n, char first) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Shifted so that first lands on -128, the letters are then the bytes below -102 (signed compare)
+    const __m128i shift = _mm_set1_epi8(char(-128 - first));
+    const __m128i limit = _mm_set1_epi8(char(-128 + 26));
+    const __m128i flip = _mm_set1_epi8(0x20);
+    for (; i + 16 <= n; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        __m128i letters = _mm_cmplt_epi8(_mm_add_epi8(chunk, shift), limit);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(s + i), _mm_xor_si128(chunk, _mm_and_si128(letters, flip)));
+    }
+#endif
+    for (; i < n; i++) {
+        if ((unsigned char)(s[i] - first) < 26) {
+            s[i] ^= 0x20;
+        }
+    }
+}
+
+inline string csqStrReplace(string_view s, string_view from, string_view to) {
+    size_t at = csqStrFind(s, from);
+    string out;
+    out.reserve(s.size());
+    size_t start = 0;
+    while (at != string_view::npos) {
+        out.append(s.data() + start, at - start);
+        out.append(to);
+        start = at + from.size();
+        at = csqStrFind(s, from, start);
+    }
+    out.append(s.data() + start, s.size() - start);
+    return out;
+}
+
+inline bool csqStrCheck(const Cell& cell, const char* builtin) {
+    if (cell.type != Type::STRING) {
+        printf("%s\n", (string("Csq TypeError: ") + builtin + " expects a string").c_str());
+        return false;
+    }
+    return true;
+}
+
+//Parts of s between the occurrences of sep, split(s) splits on runs of whitespace
+Cell split(const Cell& s, const Cell& sep){
+    if (!csqStrCheck(s, "split") || !csqStrCheck(sep, "split")) {
+        return Cell(vector<Cell>());
+    }
+    if (sep.stringVal->empty()) {
+        printf("%s\n", string("Csq ValueError: empty separator").c_str());
+        return Cell(vector<Cell>());
+    }
+    CsqListBuilder parts(csqStrCount(*s.stringVal, *sep.stringVal) + 1);
+    csqStrSplit(*s.stringVal, *sep.stringVal, [&](string_view part) { parts.push(string(part)); });
+    return parts.take();
+}
+
+Cell split(const Cell& s){
+    if (!csqStrCheck(s, "split")) {
+        return Cell(vector<Cell>());
+    }
+    CsqListBuilder parts;
+    csqStrSplitWords(*s.stringVal, [&](string_view part) { parts.push(string(part)); });
+    return parts.take();
+}
+
+//Position of the first occurrence of sub in s, -1 if there is none
+Cell find(const Cell& s, const Cell& sub){
+    if (!csqStrCheck(s, "find") || !csqStrCheck(sub, "find")) {
+        return Cell(-1);
+    }
+    size_t at = csqStrFind(*s.stringVal, *sub.stringVal);
+    return Cell(at == string_view::npos ? -1 : int(at));
+}
+
+//Number of non-overlapping occurrences of sub in s
+Cell count(const Cell& s, const Cell& sub){
+    if (!csqStrCheck(s, "count") || !csqStrCheck(sub, "count")) {
+        return Cell(0);
+    }
+    return Cell(int(csqStrCount(*s.stringVal, *sub.stringVal)));
+}
+
+//Copy of s with every occurrence of old replaced by new
+Cell replace(const Cell& s, const Cell& old, const Cell& new_){
+    if (!csqStrCheck(s, "replace") || !csqStrCheck(old, "replace") || !csqStrCheck(new_, "replace")) {
+        return s;
+    }
+    if (old.stringVal->empty()) {
+        printf("%s\n", string("Csq ValueError: replace of an empty string").c_str());
+        return s;
+    }
+    return Cell(csqStrReplace(*s.stringVal, *old.stringVal, *new_.stringVal));
+}
+
+//s without its leading and trailing whitespace
+Cell strip(const Cell& s){
+    if (!csqStrCheck(s, "strip")) {
+        return s;
+    }
+    return Cell(string(csqStrStrip(*s.stringVal)));
+}
+
+//ASCII letters of s in lower and upper case, other bytes are kept
+Cell lower(const Cell& s){
+    if (!csqStrCheck(s, "lower")) {
+        return s;
+    }
+    string out = *s.stringVal;
+    csqStrCase(out.data(), out.size(), 'A');
+    return Cell(std::move(out));
+}
+
+Cell upper(const Cell& s){
+    if (!csqStrCheck(s, "upper")) {
+        return s;
+    }
+    string out = *s.stringVal;
+    csqStrCase(out.data(), out.size(), 'a');
+    return Cell(std::move(out));
+}
+
+//1 if s begins with prefix, else 0
+Cell startswith(const Cell& s, const Cell& prefix){
+    if (!csqStrCheck(s, "startswith") || !csqStrCheck(prefix, "startswith")) {
+        return Cell(0);
+    }
+    return Cell(int(string_view(*s.stringVal).starts_with(*prefix.stringVal)));
+}
+
+#endif // STRINGS_CSQ4
@@ -1,10 +1,11 @@
 #include <Csq/Core/Runtime/memory.h>
 #include <Csq/Core/Runtime/core.h>
+#include <Csq/Core/Runtime/native.h>
 
-auto sys=[&](Cell command){
-    system(command.stringVal->c_str());
+CSQ_NATIVE(sys)(CsqString command){
+    return Cell(system(string(command).c_str()));
 };
 
-auto shutdown=[&](){
-    system("shutdown");
+CSQ_NATIVE(shutdown)(){
+    return Cell(system("shutdown"));
 };
\ No newline at end of file
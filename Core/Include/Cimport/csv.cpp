@@ -2,47 +2,45 @@
 #include <fstream>
 #include <vector>
 #include <string>
-#include <sstream>
+#include <charconv>
 #include <Csq/Core/Runtime/memory.h>
 #include <Csq/Core/Runtime/core.h>
+#include <Csq/Core/Runtime/native.h>
+#include <Csq/Core/Builtin/strings.h>
 
-auto splitString=[&](const std::string& input, char delimiter){
-    std::vector<std::string> result;
-    std::istringstream stream(input);
-    std::string token;
+CSQ_NATIVE(readCSV)(CsqString filename) {
 
-    while (std::getline(stream, token, delimiter)) {
-        result.push_back(token);
-    }
-
-    return result;
-};
-auto readCSV=[&](Cell fln) {
-
-    string filename = (*fln.stringVal);
-    Cell data;
-    ifstream file(filename);
+    ifstream file{string(filename)};
     string line;
 
-    vector<Cell> _data;
+    CsqListBuilder _data;
     while (std::getline(file, line)) {
-        line += ",";
-        vector<Cell> _line;
-        for(string val : splitString(line, ',')){
-            if(val[0] == '\"'){
-
-                _line.push_back(Cell(val.substr(1,val.size()-2)));
+        if(!line.empty() && line.back() == '\r'){
+            line.pop_back();
+        }
+        // The fields are views into line, only strings are copied out
+        CsqListBuilder _line(csqStrCountByte(line, ',') + 1);
+        csqStrSplit(line, ",", [&](string_view field){
+            string_view val = csqStrStrip(field);
+            if(!val.empty() && val[0] == '\"'){
+                _line.push(string(val.substr(1, val.size() >= 2 ? val.size() - 2 : 0)));
+                return;
+            }
+            // from_chars takes no leading '+', a field is a number only when it is read up to its end
+            string_view digits = val;
+            if(digits.size() > 1 && digits[0] == '+' && digits[1] != '-'){
+                digits.remove_prefix(1);
+            }
+            double number;
+            auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), number);
+            if(ec == std::errc() && end == digits.data() + digits.size()){
+                _line.push(number);
             }
             else{
-                _line.push_back(Cell(std::stod(val)));
+                _line.push(string(val));
             }
-        }
-        Cell lne;
-        lne.vectorVal = new vector<Cell>(_line);
-        lne.type = Type::COMPOUND;
-        _data.push_back(lne);
+        });
+        _data.push(_line.take());
     }
-    data.vectorVal = new vector<Cell>(_data);
-    data.type = Type::COMPOUND;
-    return data;
+    return _data.take();
 };
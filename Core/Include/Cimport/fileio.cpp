@@ -1,43 +1,43 @@
 #include <Csq/Core/Runtime/memory.h>
 #include <Csq/Core/Runtime/core.h>
+#include <Csq/Core/Runtime/native.h>
 #include <bits/stdc++.h>
 // Function to read the contents of a text file
-auto readFile=[&](Cell filename) {
-    std::ifstream file(*(filename.stringVal));
+CSQ_NATIVE(readFile)(CsqString filename) {
+    std::ifstream file{string(filename)};
     if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + *(filename.stringVal));
+        throw std::runtime_error("Failed to open file: " + string(filename));
     }
 
     std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
     file.close();
 
-    return Cell(content);
+    return Cell(std::move(content));
 };
 
-auto writeFile=[&](Cell filename, Cell content) {
-    std::ofstream file(*(filename.stringVal));
+CSQ_NATIVE(writeFile)(CsqString filename, CsqString content) {
+    std::ofstream file{string(filename)};
     if (!file.is_open()) {
-        throw std::runtime_error("Failed to create or open file: " + *(filename.stringVal));
+        throw std::runtime_error("Failed to create or open file: " + string(filename));
     }
 
-    file << *(content.stringVal);
+    file.write(content.data(), content.size());
     file.close();
+    return Cell();
 };
 // Function to read lines from a text file into a vector of strings
-auto readLines=[&](Cell filename) {
-    Cell lines;
-    vector<Cell> lines_;
-    std::ifstream file(*(filename.stringVal));
+CSQ_NATIVE(readLines)(CsqString filename) {
+    CsqListBuilder lines_;
+    std::ifstream file{string(filename)};
     if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + *(filename.stringVal));
+        throw std::runtime_error("Failed to open file: " + string(filename));
     }
 
     std::string line;
     while (std::getline(file, line)) {
-        lines_.push_back(Cell(line));
+        lines_.push(std::move(line));
     }
-    lines.vectorVal = new vector<Cell>(lines_);
     file.close();
 
-    return lines;
-};
\ No newline at end of file
+    return lines_.take();
+};
@@ -1,139 +1,186 @@
 #include <Csq/Core/Runtime/memory.h>
 #include <Csq/Core/Runtime/core.h>
+#include <Csq/Core/Runtime/native.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
 
-auto plot=[&](Cell x, Cell y){
-    string x_arr = "[";
-    string y_arr = "[";
-    
-    for(Cell e : *(x.vectorVal)){
-        switch(e.type){
-            case Type::INT:{
-                x_arr += to_string(e.intVal) + ",";
-                break;
-            }
-            case Type::FLOAT:{
-                x_arr += to_string(e.floatVal) + ",";
-                break;
-            }
+/*
+The series are handed to matplotlib as raw float64 in a temporary file,
+which a fixed script maps into memory, so the size of the data is not bound
+by the length of a command line. Layout of the file, native byte order:
+
+    "CSQPLOT1", int64 number of series
+    per series: int64 kind (0 plot, 1 scatter, 2 bar, 3 pie), int64 n,
+                int64 1 if x holds labels,
+                x as n float64 or as n int64 sizes followed by the utf-8
+                bytes of the labels padded to 8 bytes,
+                y as n float64
+
+When y is a compound of compounds every element is a series, drawn in the
+same figure; x is then shared or, as a compound of compounds too, paired
+with them.
+*/
+const char* csqPlotScript =
+    "import mmap, struct, sys\n"
+    "import matplotlib.pyplot as plt\n"
+    "f = open(sys.argv[1], \"rb\")\n"
+    "m = memoryview(mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ))\n"
+    "count, = struct.unpack_from(\"q\", m, 8)\n"
+    "p = 16\n"
+    "for _ in range(count):\n"
+    "    kind, n, labelled = struct.unpack_from(\"3q\", m, p)\n"
+    "    p += 24\n"
+    "    if labelled:\n"
+    "        sizes = m[p:p + 8 * n].cast(\"q\")\n"
+    "        p += 8 * n\n"
+    "        x = []\n"
+    "        for size in sizes:\n"
+    "            x.append(str(m[p:p + size], \"utf-8\"))\n"
+    "            p += size\n"
+    "        p = (p + 7) & ~7\n"
+    "    else:\n"
+    "        x = m[p:p + 8 * n].cast(\"d\")\n"
+    "        p += 8 * n\n"
+    "    y = m[p:p + 8 * n].cast(\"d\")\n"
+    "    p += 8 * n\n"
+    "    if kind == 0:\n"
+    "        plt.plot(x, y)\n"
+    "    elif kind == 1:\n"
+    "        plt.scatter(x, y)\n"
+    "    elif kind == 2:\n"
+    "        plt.bar(x, y)\n"
+    "    else:\n"
+    "        plt.pie(y, labels=x)\n"
+    "plt.show()\n";
+
+auto csqPlotWriteInts=[&](FILE* out, long long value){
+    fwrite(&value, sizeof(value), 1, out);
+};
+
+auto csqPlotWriteNumbers=[&](FILE* out, CsqNumbers values){
+    // Converted in blocks, the cells are not laid out as doubles
+    double block[4096];
+    size_t used = 0;
+    for(double value : values){
+        block[used++] = value;
+        if(used == 4096){
+            fwrite(block, sizeof(double), used, out);
+            used = 0;
         }
     }
-    x_arr.pop_back();
-    x_arr += "]";
+    fwrite(block, sizeof(double), used, out);
+};
 
-    for(Cell e : *(y.vectorVal)){
-        switch(e.type){
-            case Type::INT:{
-                y_arr += to_string(e.intVal) + ",";
-                break;
-            }
-            case Type::FLOAT:{
-                y_arr += to_string(e.floatVal) + ",";
-                break;
-            }
-        }
+auto csqPlotWriteLabels=[&](FILE* out, CsqList labels){
+    size_t bytes = 0;
+    for(const Cell& label : labels){
+        CsqString text(label);
+        csqPlotWriteInts(out, (long long)text.size());
+        bytes += text.size();
     }
-    y_arr.pop_back();
-    y_arr += "]";
-    // cout << x_arr << endl;
-    string code = "import matplotlib.pyplot as plt;plt.plot(" + x_arr + "," + y_arr + ");plt.show();";
-    string command = "python3 -c \"" + code + "\"";
-    int r = system(command.c_str());
+    for(const Cell& label : labels){
+        CsqString text(label);
+        fwrite(text.data(), 1, text.size(), out);
+    }
+    const char padding[8] = {0};
+    fwrite(padding, 1, (8 - bytes % 8) % 8, out);
 };
 
-auto scatter=[&](Cell x, Cell y){
-    string x_arr = "[";
-    string y_arr = "[";
-    
-    for(Cell e : *(x.vectorVal)){
-        switch(e.type){
-            case Type::INT:{
-                x_arr += to_string(e.intVal) + ",";
-                break;
-            }
-            case Type::FLOAT:{
-                x_arr += to_string(e.floatVal) + ",";
-                break;
+auto csqPlotShow=[&](long long kind, const Cell& x, const Cell& y){
+    if(x.type != Type::COMPOUND || y.type != Type::COMPOUND){
+        printf("%s\n", string("Csq TypeError: plotting expects compounds").c_str());
+        return Cell(-1);
+    }
+    // (x, y) of every series
+    vector<pair<const Cell*, const Cell*>> series;
+    bool batched = !y.vectorVal->empty() && (*y.vectorVal)[0].type == Type::COMPOUND;
+    bool pairedX = batched && !x.vectorVal->empty() && (*x.vectorVal)[0].type == Type::COMPOUND;
+    if(pairedX && x.vectorVal->size() != y.vectorVal->size()){
+        printf("%s\n", string("Csq ValueError: as many x as y series are needed").c_str());
+        return Cell(-1);
+    }
+    if(!batched){
+        series.push_back({&x, &y});
+    }
+    for(size_t i = 0; batched && i < y.vectorVal->size(); i++){
+        const Cell& xs = pairedX ? (*x.vectorVal)[i] : x;
+        series.push_back({&xs, &(*y.vectorVal)[i]});
+    }
+    for(auto& [xs, ys] : series){
+        if(xs->type != Type::COMPOUND || ys->type != Type::COMPOUND ||
+           xs->vectorVal->size() != ys->vectorVal->size()){
+            printf("%s\n", string("Csq ValueError: x and y of a series must be compounds of the same length").c_str());
+            return Cell(-1);
+        }
+        // Checked before anything is written, the file header holds the length of every series
+        bool labelled = !xs->vectorVal->empty() && (*xs->vectorVal)[0].type == Type::STRING;
+        for(size_t i = 0; i < ys->vectorVal->size(); i++){
+            const Cell& xi = (*xs->vectorVal)[i];
+            const Cell& yi = (*ys->vectorVal)[i];
+            bool xValid = labelled ? xi.type == Type::STRING : xi.type == Type::INT || xi.type == Type::FLOAT;
+            if(!xValid || (yi.type != Type::INT && yi.type != Type::FLOAT)){
+                printf("%s\n", string(labelled ? "Csq TypeError: x must hold labels only and y numbers"
+                                                : "Csq TypeError: x and y must hold numbers").c_str());
+                return Cell(-1);
             }
         }
     }
-    x_arr.pop_back();
-    x_arr += "]";
 
-    for(Cell e : *(y.vectorVal)){
-        switch(e.type){
-            case Type::INT:{
-                y_arr += to_string(e.intVal) + ",";
-                break;
-            }
-            case Type::FLOAT:{
-                y_arr += to_string(e.floatVal) + ",";
-                break;
-            }
+    // The path is passed between single quotes
+    const char* tmp = getenv("TMPDIR");
+    if(tmp == nullptr || strchr(tmp, '\'') != nullptr){
+        tmp = "/tmp";
+    }
+    string path = string(tmp) + "/csqplotXXXXXX";
+    int fd = mkstemp(path.data());
+    FILE* out = fd < 0 ? nullptr : fdopen(fd, "wb");
+    if(out == nullptr){
+        printf("%s\n", string("Csq IOError: can't create the plot data file " + path).c_str());
+        return Cell(-1);
+    }
+    fwrite("CSQPLOT1", 1, 8, out);
+    csqPlotWriteInts(out, (long long)series.size());
+    for(auto& [xs, ys] : series){
+        bool labelled = !xs->vectorVal->empty() && (*xs->vectorVal)[0].type == Type::STRING;
+        csqPlotWriteInts(out, kind);
+        csqPlotWriteInts(out, (long long)ys->vectorVal->size());
+        csqPlotWriteInts(out, labelled ? 1 : 0);
+        if(labelled){
+            csqPlotWriteLabels(out, *xs);
+        }
+        else{
+            csqPlotWriteNumbers(out, *xs);
         }
+        csqPlotWriteNumbers(out, *ys);
     }
-    y_arr.pop_back();
-    y_arr += "]";
-    // cout << x_arr << endl;
-    string code = "import matplotlib.pyplot as plt;plt.scatter(" + x_arr + "," + y_arr + ");plt.show();";
-    string command = "python3 -c \"" + code + "\"";
+    bool written = !ferror(out);
+    written = fclose(out) == 0 && written;
+    if(!written){
+        printf("%s\n", string("Csq IOError: can't write the plot data file " + path).c_str());
+        unlink(path.c_str());
+        return Cell(-1);
+    }
+
+    // The script has no single quote either
+    string command = "python3 -c '" + string(csqPlotScript) + "' '" + path + "'";
     int r = system(command.c_str());
+    unlink(path.c_str());
+    return Cell(r);
 };
 
-auto bar=[&](Cell x, Cell y){
-    string x_arr = "[";
-    string y_arr = "[";
-    
-    for(Cell e : *(x.vectorVal)){
-            x_arr += (*e.stringVal) + ",";
-    }
-    x_arr.pop_back();
-    x_arr += "]";
+CSQ_NATIVE(plot)(const Cell& x, const Cell& y){
+    return csqPlotShow(0, x, y);
+};
 
-    for(Cell e : *(y.vectorVal)){
-        switch(e.type){
-            case Type::INT:{
-                y_arr += to_string(e.intVal) + ",";
-                break;
-            }
-            case Type::FLOAT:{
-                y_arr += to_string(e.floatVal) + ",";
-                break;
-            }
-        }
-    }
-    y_arr.pop_back();
-    y_arr += "]";
-    
-    string code = "import matplotlib.pyplot as plt;plt.bar(" + x_arr + "," + y_arr + ");plt.show();";
-    string command = "python3 -c \"" + code + "\"";
-    int r = system(command.c_str());
+CSQ_NATIVE(scatter)(const Cell& x, const Cell& y){
+    return csqPlotShow(1, x, y);
 };
-auto pie=[&](Cell x, Cell y){
-    string x_arr = "[";
-    string y_arr = "[";
-    
-    for(Cell e : *(x.vectorVal)){
-            x_arr += (*e.stringVal) + ",";
-    }
-    x_arr.pop_back();
-    x_arr += "]";
 
-    for(Cell e : *(y.vectorVal)){
-        switch(e.type){
-            case Type::INT:{
-                y_arr += to_string(e.intVal) + ",";
-                break;
-            }
-            case Type::FLOAT:{
-                y_arr += to_string(e.floatVal) + ",";
-                break;
-            }
-        }
-    }
-    y_arr.pop_back();
-    y_arr += "]";
-    
-    string code = "import matplotlib.pyplot as plt;plt.pie(" + y_arr + ",labels = " + x_arr + ");plt.show();";
-    string command = "python3 -c \"" + code + "\"";
-    int r = system(command.c_str());
-};
\ No newline at end of file
+CSQ_NATIVE(bar)(const Cell& x, const Cell& y){
+    return csqPlotShow(2, x, y);
+};
+CSQ_NATIVE(pie)(const Cell& x, const Cell& y){
+    return csqPlotShow(3, x, y);
+};
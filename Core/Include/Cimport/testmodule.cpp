@@ -1,5 +1,6 @@
 
-auto fizz=[&](){
+CSQ_NATIVE(fizz)(){
     printf("Buzz Buzz");
+    return Cell();
 };
 
@@ -3,6 +3,7 @@
 
 int line_ = 1;
 
+#include "profile.h"
 #include "object.h"
 #include "memory.h"
 #include "function.h"
@@ -12,6 +13,9 @@ int line_ = 1;
 map<string, int> SymTable;
 map<string, Class> __classes__;
 
+#include "iterator.h"
+#include "native.h"
+
 inline bool inTable(const std::string& name) {
     return SymTable.find(name) != SymTable.end();
 }
@@ -28,8 +32,12 @@ inline const Cell& id(const std::string& identifier) {
 }
 
 inline void allocateVar(const std::string& id_, const Cell& c) {
+    if (csqBindings != nullptr) {
+        csqBindings->record(id_);
+    }
     memory.push_back(c);
     SymTable[id_] = static_cast<int>(memory.size()) - 1;
+    CSQ_MEM_VARIABLE(memory.size());
 }
 
 inline void assignVar(const std::string& id_, const Cell& c) {
@@ -0,0 +1,274 @@
+#if !defined(ITERATOR_CSQ4)
+#define ITERATOR_CSQ4
+
+/*
+Lazy sequences and the cursor behind `for x in <value>`.
+
+A for loop walks compounds in place (no index lookups, no copy of the
+list), ranges without materializing them and generators one value at a
+time. The current value is written into the memory cell of the loop
+variable, reusing its buffer when the type doesn't change.
+
+Generator functions (functions containing `yield`) are compiled to C++20
+coroutines returning a Cell, CsqCoroutine wraps the coroutine into an
+ITERATOR cell. Variables are bound by name in SymTable, the names bound by
+a generator are given back to the caller whenever it yields.
+*/
+
+#include <cstdio>
+#include <map>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#include "memory.h"
+
+extern map<string, int> SymTable;
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#endif
+
+/*
+dst = val, releasing the previous value of dst when its type changes: Cell's
+assignment operators don't, so dst is rebuilt in place instead. Used for the
+loop variables here and for the registers of the VM.
+*/
+inline void csqBind(Cell& dst, Cell&& val);
+
+inline void csqBind(Cell& dst, const Cell& val) {
+    if (&dst == &val) {
+        return;
+    }
+    if (dst.type == Type::COMPOUND) {
+        // val may be one of dst's own elements (x = x[0]), copied before dst lets go of it
+        csqBind(dst, Cell(val));
+        return;
+    }
+    if (dst.type == val.type && val.type == Type::INT) {
+        dst.intVal = val.intVal;
+    } else if (dst.type == val.type && val.type == Type::FLOAT) {
+        dst.floatVal = val.floatVal;
+    } else if (dst.type == val.type && val.type != Type::CUSTYPE) {
+        dst = val;
+    } else {
+        dst.~Cell();
+        new (&dst) Cell(val);
+    }
+}
+
+inline void csqBind(Cell& dst, Cell&& val) {
+    dst.~Cell();
+    new (&dst) Cell(std::move(val));
+}
+
+inline void csqBind(Cell& dst, int val) {
+    if (dst.type == Type::INT) {
+        dst.intVal = val;
+    } else {
+        csqBind(dst, Cell(val));
+    }
+}
+
+// start, start + step, ... up to stop (excluded)
+struct CsqRange : CsqIterator {
+    int start, stop, step;
+    int current;
+
+    CsqRange(int start_, int stop_, int step_) : start(start_), stop(stop_), step(step_), current(start_) {}
+
+    bool next(Cell& out) override {
+        if (step > 0 ? current >= stop : current <= stop) {
+            return false;
+        }
+        csqBind(out, current);
+        current += step;
+        return true;
+    }
+
+    CsqIterator* iterate() override {
+        return new CsqRange(start, stop, step);
+    }
+
+    string name() const override {
+        return "range";
+    }
+};
+
+/*
+Cursor of a for loop, writes every value of the sequence into memory[slot].
+Temporaries (for x in f()) are owned by the cursor, variables are borrowed.
+*/
+class CsqCursor {
+public:
+    CsqCursor(const Cell& source, size_t slot) : slot_(slot) {
+        start(source);
+    }
+
+    CsqCursor(Cell&& source, size_t slot) : owned_(std::move(source)), slot_(slot) {
+        start(owned_);
+    }
+
+    ~CsqCursor() {
+        if (iter_ != nullptr && --iter_->refs == 0) {
+            delete iter_;
+        }
+    }
+
+    CsqCursor(const CsqCursor&) = delete;
+    CsqCursor& operator=(const CsqCursor&) = delete;
+
+    inline bool next() {
+        if (list_ != nullptr) {
+            // The size is read again since the body may grow or shrink the list
+            if (index_ >= list_->size()) {
+                return false;
+            }
+            csqBind(memory[slot_], (*list_)[index_++]);
+            return true;
+        }
+        if (range_ != nullptr) {
+            if (range_->step > 0 ? current_ >= range_->stop : current_ <= range_->stop) {
+                return false;
+            }
+            csqBind(memory[slot_], current_);
+            current_ += range_->step;
+            return true;
+        }
+        return iter_ != nullptr && iter_->next(memory[slot_]);
+    }
+
+private:
+    Cell owned_;
+    const vector<Cell>* list_ = nullptr;
+    size_t index_ = 0;
+    const CsqRange* range_ = nullptr;
+    int current_ = 0;
+    CsqIterator* iter_ = nullptr;
+    size_t slot_;
+
+    void start(const Cell& source) {
+        if (source.type == Type::COMPOUND) {
+            list_ = source.vectorVal;
+        } else if (source.type == Type::ITERATOR) {
+            // Ranges are walked from their bounds, no virtual call per value
+            range_ = dynamic_cast<const CsqRange*>(source.iterVal);
+            if (range_ != nullptr) {
+                current_ = range_->start;
+                iter_ = source.iterVal;
+                iter_->refs++;
+            } else {
+                iter_ = source.iterVal->iterate();
+            }
+        } else {
+            printf("%s\n", string("Csq TypeError: for loops can only iterate over compounds, ranges and generators").c_str());
+        }
+    }
+};
+
+// Names bound by a generator and the slots they have on the other side (-1 when unbound)
+struct CsqBindings {
+    vector<pair<string, int>> names;
+
+    // Called by allocateVar while the generator runs
+    void record(const string& name) {
+        for (const auto& bound : names) {
+            if (bound.first == name) {
+                return;
+            }
+        }
+        auto it = SymTable.find(name);
+        names.push_back({name, it != SymTable.end() ? it->second : -1});
+    }
+
+    // Caller's bindings <-> generator's bindings
+    void swap() {
+        for (auto& bound : names) {
+            auto it = SymTable.find(bound.first);
+            int current = it != SymTable.end() ? it->second : -1;
+            if (bound.second < 0) {
+                if (it != SymTable.end()) {
+                    SymTable.erase(it);
+                }
+            } else {
+                SymTable[bound.first] = bound.second;
+            }
+            bound.second = current;
+        }
+    }
+};
+
+// Bindings of the running generator, nullptr outside of generators
+CsqBindings* csqBindings = nullptr;
+
+#if defined(__cpp_impl_coroutine)
+
+struct CsqGeneratorPromise;
+
+struct CsqCoroutine : CsqIterator {
+    std::coroutine_handle<CsqGeneratorPromise> handle;
+    CsqBindings bindings;
+
+    explicit CsqCoroutine(std::coroutine_handle<CsqGeneratorPromise> h) : handle(h) {}
+
+    ~CsqCoroutine() override {
+        handle.destroy();
+    }
+
+    bool next(Cell& out) override;
+
+    string name() const override {
+        return "generator";
+    }
+};
+
+struct CsqGeneratorPromise {
+    Cell value;
+
+    Cell get_return_object() {
+        return Cell(new CsqCoroutine(std::coroutine_handle<CsqGeneratorPromise>::from_promise(*this)));
+    }
+    // The body starts running on the first next()
+    std::suspend_always initial_suspend() noexcept {
+        return {};
+    }
+    std::suspend_always final_suspend() noexcept {
+        return {};
+    }
+    std::suspend_always yield_value(Cell val) {
+        csqBind(value, std::move(val));
+        return {};
+    }
+    void return_void() {}
+    void unhandled_exception() {
+        std::terminate();
+    }
+};
+
+inline bool CsqCoroutine::next(Cell& out) {
+    if (handle.done()) {
+        return false;
+    }
+    CsqBindings* outer = csqBindings;
+    csqBindings = &bindings;
+    bindings.swap();
+    handle.resume();
+    bindings.swap();
+    csqBindings = outer;
+    if (handle.done()) {
+        return false;
+    }
+    csqBind(out, std::move(handle.promise().value));
+    return true;
+}
+
+// Generator functions are lambdas declared `-> Cell` whose body uses co_yield
+template <typename... Args>
+struct std::coroutine_traits<Cell, Args...> {
+    using promise_type = CsqGeneratorPromise;
+};
+
+#endif // __cpp_impl_coroutine
+
+#endif // ITERATOR_CSQ4
@@ -6,6 +6,8 @@
 #include <vector>
 #include <map>
 #include <initializer_list>
+#include <cmath>
+#include "memstats.h"
 
 using namespace std;
 
@@ -15,6 +17,23 @@ enum class Type {
     STRING,
     COMPOUND,
     CUSTYPE,
+    ITERATOR,
+};
+
+struct Cell;
+
+// Lazy sequence held by ITERATOR cells (see iterator.h), shared by every copy of the cell
+struct CsqIterator {
+    int refs = 1;
+    virtual ~CsqIterator() {}
+    // Writes the next value into out, false once the sequence is exhausted
+    virtual bool next(Cell& out) = 0;
+    // Cursor for a new loop: ranges start over, generators continue where they are
+    virtual CsqIterator* iterate() {
+        refs++;
+        return this;
+    }
+    virtual string name() const = 0;
 };
 
 struct Cell {
@@ -24,7 +43,7 @@ struct Cell {
         double floatVal;
         string* stringVal;
         vector<Cell>* vectorVal;
-        
+        CsqIterator* iterVal;
     };
     string __class__;
     // Constructors
@@ -34,9 +53,24 @@ struct Cell {
 
     inline Cell(double val) : type(Type::FLOAT), floatVal(val) {}
 
-    inline Cell(const string& val) : type(Type::STRING), stringVal(new string(val)) {}
+    inline Cell(const string& val) : type(Type::STRING), stringVal(new string(val)) {
+        CSQ_MEM_ALLOC(type, heapBytes());
+    }
+
+    inline Cell(string&& val) : type(Type::STRING), stringVal(new string(std::move(val))) {
+        CSQ_MEM_ALLOC(type, heapBytes());
+    }
+
+    inline Cell(const vector<Cell>& val) : type(Type::COMPOUND), vectorVal(new vector<Cell>(val)) {
+        CSQ_MEM_ALLOC(type, heapBytes());
+    }
+
+    inline Cell(vector<Cell>&& val) : type(Type::COMPOUND), vectorVal(new vector<Cell>(std::move(val))) {
+        CSQ_MEM_ALLOC(type, heapBytes());
+    }
+    // Takes over a reference to it
+    inline explicit Cell(CsqIterator* it) : type(Type::ITERATOR), iterVal(it) {}
 
-    inline Cell(const vector<Cell>& val) : type(Type::COMPOUND), vectorVal(new vector<Cell>(val)) {}
     inline Cell(initializer_list<Cell> val){
         vector<Cell> v;
         for(Cell c : val){
@@ -44,24 +78,45 @@ struct Cell {
         }
         vectorVal = new vector<Cell>(v);
         type = Type::COMPOUND;
+        CSQ_MEM_ALLOC(type, heapBytes());
     }
     ~Cell() {
     switch (type) {
         case Type::STRING:
             if (stringVal != nullptr) {
+                CSQ_MEM_FREE(type, heapBytes());
                 delete stringVal;
             }
             break;
         case Type::COMPOUND:
             if (vectorVal != nullptr) {
+                CSQ_MEM_FREE(type, heapBytes());
                 delete vectorVal;
             }
             break;
+        case Type::ITERATOR:
+            if (iterVal != nullptr && --iterVal->refs == 0) {
+                delete iterVal;
+            }
+            break;
         // Add cases for other types as needed
     }
 }
+    // Size of the heap object owned by the cell, for the memory statistics
+    inline size_t heapBytes() const {
+        switch (type) {
+            case Type::STRING:
+                // Short strings live inside the string object itself
+                return sizeof(string) + (stringVal->capacity() > 15 ? stringVal->capacity() + 1 : 0);
+            case Type::COMPOUND:
+                return sizeof(vector<Cell>) + vectorVal->capacity() * sizeof(Cell);
+            default:
+                return 0;
+        }
+    }
     // Copy Constructor
     inline Cell(const Cell& other) : type(other.type) {
+        CSQ_MEM_COPY(type);
         switch (other.type) {
             case Type::INT:
                 intVal = other.intVal;
@@ -71,18 +126,26 @@ struct Cell {
                 break;
             case Type::STRING:
                 stringVal = new string(*other.stringVal);
+                CSQ_MEM_ALLOC(type, heapBytes());
                 break;
             case Type::COMPOUND:
                 vectorVal = new vector<Cell>(*other.vectorVal);
+                CSQ_MEM_ALLOC(type, heapBytes());
                 break;
             case Type::CUSTYPE:
                 __class__ = (other.__class__);
                 break;
+            case Type::ITERATOR:
+                iterVal = other.iterVal;
+                iterVal->refs++;
+                break;
         }
     }
 
     // Move Constructor
-    inline Cell(Cell&& other) : type(other.type) {
+    // noexcept lets vector<Cell> move its elements when it grows instead of copying them
+    inline Cell(Cell&& other) noexcept : type(other.type) {
+        CSQ_MEM_MOVE(type);
         switch (other.type) {
             case Type::INT:
                 intVal = other.intVal;
@@ -98,6 +161,13 @@ struct Cell {
                 vectorVal = other.vectorVal;
                 other.vectorVal = nullptr;
                 break;
+            case Type::CUSTYPE:
+                __class__ = std::move(other.__class__);
+                break;
+            case Type::ITERATOR:
+                iterVal = other.iterVal;
+                other.iterVal = nullptr;
+                break;
             default:
                 break;
         }
@@ -115,10 +185,19 @@ struct Cell {
                         floatVal = other.floatVal;
                         break;
                     case Type::STRING:
-                        *stringVal = *other.stringVal;
+                        CSQ_MEM_COPY(type);
+                        CSQ_MEM_TRACK(*this, *stringVal = *other.stringVal);
                         break;
                     case Type::COMPOUND:
-                        *vectorVal = *other.vectorVal;
+                        CSQ_MEM_COPY(type);
+                        CSQ_MEM_TRACK(*this, *vectorVal = *other.vectorVal);
+                        break;
+                    case Type::ITERATOR:
+                        other.iterVal->refs++;
+                        if (--iterVal->refs == 0) {
+                            delete iterVal;
+                        }
+                        iterVal = other.iterVal;
                         break;
                     default:
                         break;
@@ -198,6 +277,32 @@ struct Cell {
         return Cell(); // Default case
     }
 
+    // A zero divisor gives 0 rather than trapping
+    inline Cell operator%(const Cell& other) const {
+        if (type == Type::INT && other.type == Type::INT) {
+            return Cell(other.intVal != 0 ? intVal % other.intVal : 0);
+        }
+        double a = type == Type::INT ? intVal : floatVal;
+        double b = other.type == Type::INT ? other.intVal : other.floatVal;
+        return Cell(b != 0.0 ? fmod(a, b) : 0.0);
+    }
+
+    // Truth value used by not, and, or: zero and empty strings or compounds are false
+    inline explicit operator bool() const {
+        switch (type) {
+            case Type::INT:
+                return intVal != 0;
+            case Type::FLOAT:
+                return floatVal != 0.0;
+            case Type::STRING:
+                return !stringVal->empty();
+            case Type::COMPOUND:
+                return !vectorVal->empty();
+            default:
+                return true;
+        }
+    }
+
     inline bool operator==(const Cell& other) const {
             switch (type) {
                 case Type::INT:
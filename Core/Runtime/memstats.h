@@ -0,0 +1,122 @@
+#if !defined(MEMSTATS_CSQ4)
+#define MEMSTATS_CSQ4
+
+/*
+Allocation counters used by `csq --memstats`.
+
+Cell reports every heap object it creates or releases, every copy and move
+through the CSQ_MEM_* hooks, indexed by Type. The hooks expand to nothing
+unless CSQ_MEMSTATS is defined, the counters then stay at zero. With
+CSQ_MEMSTATS the counters are dumped on stderr when the program exits,
+`live` at that point is memory that was never released.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+struct CsqMemCounters {
+    uint64_t allocs;  // heap objects (strings, compounds) created
+    uint64_t frees;   // heap objects released
+    uint64_t bytes;   // bytes allocated in total
+    uint64_t copies;  // copy constructions and copy assignments
+    uint64_t moves;   // move constructions
+    int64_t live;     // bytes currently held
+    int64_t peak;     // highest value of live
+};
+
+const int CSQ_MEM_TYPES = 6;
+const char* const csqMemTypeNames[CSQ_MEM_TYPES] = {"int", "float", "string", "compound", "custype", "iterator"};
+
+CsqMemCounters csqMemCounters[CSQ_MEM_TYPES];
+int64_t csqMemLive = 0;
+int64_t csqMemPeak = 0;
+uint64_t csqMemVariables = 0;
+size_t csqMemCellsPeak = 0;
+
+inline void csqMemAlloc(int type, size_t bytes) {
+    CsqMemCounters& c = csqMemCounters[type];
+    c.allocs++;
+    c.bytes += bytes;
+    c.live += bytes;
+    c.peak = c.live > c.peak ? c.live : c.peak;
+    csqMemLive += bytes;
+    csqMemPeak = csqMemLive > csqMemPeak ? csqMemLive : csqMemPeak;
+}
+
+inline void csqMemFree(int type, size_t bytes) {
+    csqMemCounters[type].frees++;
+    csqMemCounters[type].live -= bytes;
+    csqMemLive -= bytes;
+}
+
+// A heap object changed size in place (assignment, push_back...), see CSQ_MEM_TRACK
+inline void csqMemResize(int type, size_t before, size_t after) {
+    if (after > before) {
+        csqMemCounters[type].bytes += after - before;
+    }
+    CsqMemCounters& c = csqMemCounters[type];
+    c.live += int64_t(after) - int64_t(before);
+    c.peak = c.live > c.peak ? c.live : c.peak;
+    csqMemLive += int64_t(after) - int64_t(before);
+    csqMemPeak = csqMemLive > csqMemPeak ? csqMemLive : csqMemPeak;
+}
+
+inline void csqMemVariable(size_t cells) {
+    csqMemVariables++;
+    csqMemCellsPeak = cells > csqMemCellsPeak ? cells : csqMemCellsPeak;
+}
+
+inline void csqMemDump(FILE* out) {
+    fprintf(out, "%-10s %12s %12s %14s %12s %12s %14s %14s\n", "type", "allocs", "frees", "bytes", "copies", "moves",
+            "live bytes", "peak bytes");
+    for (int t = 0; t < CSQ_MEM_TYPES; t++) {
+        const CsqMemCounters& c = csqMemCounters[t];
+        fprintf(out, "%-10s %12llu %12llu %14llu %12llu %12llu %14lld %14lld\n", csqMemTypeNames[t],
+                (unsigned long long)c.allocs, (unsigned long long)c.frees, (unsigned long long)c.bytes,
+                (unsigned long long)c.copies, (unsigned long long)c.moves, (long long)c.live, (long long)c.peak);
+    }
+    fprintf(out, "heap bytes live %lld, peak %lld\n", (long long)csqMemLive, (long long)csqMemPeak);
+    fprintf(out, "variables allocated %llu, peak memory cells %zu\n", (unsigned long long)csqMemVariables,
+            csqMemCellsPeak);
+}
+
+#if defined(CSQ_MEMSTATS)
+
+#define CSQ_MEM_ALLOC(type, bytes) csqMemAlloc(int(type), bytes)
+#define CSQ_MEM_FREE(type, bytes) csqMemFree(int(type), bytes)
+// Runs stmt, which may resize the heap object of cell in place
+#define CSQ_MEM_TRACK(cell, stmt)                                          \
+    {                                                                      \
+        size_t __csq_before = (cell).heapBytes();                          \
+        stmt;                                                              \
+        csqMemResize(int((cell).type), __csq_before, (cell).heapBytes());  \
+    }
+#define CSQ_MEM_COPY(type) csqMemCounters[int(type)].copies++
+#define CSQ_MEM_MOVE(type) csqMemCounters[int(type)].moves++
+#define CSQ_MEM_VARIABLE(cells) csqMemVariable(cells)
+
+// Dumps the counters once every other global has been released
+struct CsqMemReport {
+    ~CsqMemReport() {
+        fprintf(stderr, "\nCsq memory statistics\n");
+        csqMemDump(stderr);
+    }
+};
+CsqMemReport csqMemReport;
+
+#else
+
+#define CSQ_MEM_ALLOC(type, bytes)
+#define CSQ_MEM_FREE(type, bytes)
+#define CSQ_MEM_TRACK(cell, stmt) \
+    {                             \
+        stmt;                     \
+    }
+#define CSQ_MEM_COPY(type)
+#define CSQ_MEM_MOVE(type)
+#define CSQ_MEM_VARIABLE(cells)
+
+#endif // CSQ_MEMSTATS
+
+#endif // MEMSTATS_CSQ4
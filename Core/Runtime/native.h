@@ -0,0 +1,133 @@
+#if !defined(NATIVE_CSQ4)
+#define NATIVE_CSQ4
+
+/*
+Extension API of cimport modules.
+
+A module is pasted inside main, so its functions are lambdas. CSQ_NATIVE
+declares one, the compiler reads these declarations to learn the names and
+arities the module provides and checks the calls against them:
+
+    CSQ_NATIVE(mean)(CsqNumbers xs) {
+        double total = 0;
+        for (double x : xs) {
+            total += x;
+        }
+        return Cell(total / xs.size());
+    };
+
+Calls pass the caller's cells as they are (`id()` returns a const reference).
+A parameter of one of the view types below reads its argument in place,
+`const Cell&` takes it untouched, `Cell` takes a copy. Results are built
+in place with CsqListBuilder.
+*/
+
+#include <span>
+#include <string_view>
+#include "memory.h"
+
+#define CSQ_NATIVE(name) auto name = [&]
+
+// Text of a string argument
+struct CsqString : string_view {
+    CsqString(const Cell& cell) {
+        if (cell.type != Type::STRING) {
+            printf("%s\n", string("Csq TypeError: expected a string").c_str());
+            return;
+        }
+        string_view::operator=(*cell.stringVal);
+    }
+};
+
+// Elements of a compound argument
+struct CsqList : span<const Cell> {
+    CsqList() = default;
+    CsqList(const Cell& cell) {
+        if (cell.type != Type::COMPOUND) {
+            printf("%s\n", string("Csq TypeError: expected a compound").c_str());
+            return;
+        }
+        span<const Cell>::operator=(span<const Cell>(cell.vectorVal->data(), cell.vectorVal->size()));
+    }
+};
+
+// Compound of ints and floats read as doubles. Cells keep their type tag next
+// to the value, so this is a strided view over them rather than a double array.
+class CsqNumbers {
+public:
+    class iterator {
+    public:
+        using iterator_category = random_access_iterator_tag;
+        using value_type = double;
+        using difference_type = ptrdiff_t;
+        using pointer = void;
+        using reference = double;
+
+        iterator() : cell_(nullptr) {}
+        explicit iterator(const Cell* cell) : cell_(cell) {}
+        double operator*() const { return CsqNumbers::value(*cell_); }
+        double operator[](difference_type n) const { return CsqNumbers::value(cell_[n]); }
+        iterator& operator++() { ++cell_; return *this; }
+        iterator operator++(int) { iterator old = *this; ++cell_; return old; }
+        iterator& operator--() { --cell_; return *this; }
+        iterator operator--(int) { iterator old = *this; --cell_; return old; }
+        iterator& operator+=(difference_type n) { cell_ += n; return *this; }
+        iterator& operator-=(difference_type n) { cell_ -= n; return *this; }
+        iterator operator+(difference_type n) const { return iterator(cell_ + n); }
+        iterator operator-(difference_type n) const { return iterator(cell_ - n); }
+        difference_type operator-(const iterator& other) const { return cell_ - other.cell_; }
+        auto operator<=>(const iterator& other) const = default;
+
+    private:
+        const Cell* cell_;
+    };
+
+    CsqNumbers(const Cell& cell) : cells_(cell) {
+        for (const Cell& c : cells_) {
+            if (c.type != Type::INT && c.type != Type::FLOAT) {
+                printf("%s\n", string("Csq TypeError: expected a compound of numbers").c_str());
+                cells_ = CsqList();
+                break;
+            }
+        }
+    }
+
+    size_t size() const { return cells_.size(); }
+    bool empty() const { return cells_.empty(); }
+    double operator[](size_t i) const { return value(cells_[i]); }
+    iterator begin() const { return iterator(cells_.data()); }
+    iterator end() const { return iterator(cells_.data() + cells_.size()); }
+    // The cells themselves, to tell ints from floats
+    const CsqList& cells() const { return cells_; }
+
+    static double value(const Cell& c) {
+        return c.type == Type::INT ? double(c.intVal) : c.floatVal;
+    }
+
+private:
+    CsqList cells_;
+};
+
+// Compound result filled in place, take() hands it over without a copy
+class CsqListBuilder {
+public:
+    explicit CsqListBuilder(size_t reserve = 0) : list_(vector<Cell>()) {
+        CSQ_MEM_TRACK(list_, list_.vectorVal->reserve(reserve));
+    }
+
+    // Constructs the next element from args, e.g. push(1.5) or push(string(text))
+    template <class... Args>
+    Cell& push(Args&&... args) {
+        CSQ_MEM_TRACK(list_, list_.vectorVal->emplace_back(std::forward<Args>(args)...));
+        return list_.vectorVal->back();
+    }
+
+    size_t size() const { return list_.vectorVal->size(); }
+
+    Cell take() { return std::move(list_); }
+
+private:
+    Cell list_;
+};
+
+#endif // NATIVE_CSQ4
@@ -0,0 +1,297 @@
+#if !defined(PROFILE_CSQ4)
+#define PROFILE_CSQ4
+
+/*
+Runtime profiler used by `csq --profile`.
+
+The compiler places CSQ_LINE(file, line) before every statement and
+CSQ_FUNCTION(name) at the top of every function. Both expand to nothing
+unless CSQ_PROFILE is defined, so regular builds don't pay for them.
+
+With CSQ_PROFILE every marker site owns a static counter, the time between
+two markers is charged to the first one (its self time) and function
+scopes build a call tree giving calls, inclusive and exclusive time. Time
+is read from the TSC where available. The report (CSQ_PROFILE_OUTPUT.profile)
+and a flamegraph compatible folded stack file (CSQ_PROFILE_OUTPUT.folded)
+are written when the program exits.
+*/
+
+#if defined(CSQ_PROFILE)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline uint64_t csqTicks() {
+    return __rdtsc();
+}
+#else
+inline uint64_t csqTicks() {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+#endif
+
+#if !defined(CSQ_PROFILE_OUTPUT)
+#define CSQ_PROFILE_OUTPUT "csq"
+#endif
+
+extern int line_;
+
+// Counters of a single CSQ_LINE site (trivially destructible on purpose,
+// the report reads them after main returns)
+struct CsqLineStat {
+    const char* file;
+    int line;
+    uint64_t hits;
+    uint64_t ticks;
+};
+
+// Counters of a single CSQ_FUNCTION site
+struct CsqFunctionStat {
+    const char* name;
+    uint64_t calls;
+    uint64_t inclusive;
+    uint64_t exclusive;
+    int active;
+};
+
+struct CsqCallNode {
+    CsqFunctionStat* fn;
+    uint64_t self;
+    std::vector<CsqCallNode*> children;
+
+    CsqCallNode* child(CsqFunctionStat* f) {
+        for (CsqCallNode* node : children) {
+            if (node->fn == f) {
+                return node;
+            }
+        }
+        children.push_back(new CsqCallNode{f, 0, {}});
+        return children.back();
+    }
+};
+
+struct CsqFrame {
+    CsqCallNode* node;
+    CsqLineStat* line;
+    uint64_t start;
+    uint64_t childTicks;
+};
+
+class CsqProfiler {
+public:
+    CsqProfiler()
+        : mainStat_{"main", 1, 0, 0, 1},
+          root_{&mainStat_, 0, {}},
+          current_(nullptr),
+          startClock_(std::chrono::steady_clock::now()) {
+        last_ = start_ = csqTicks();
+        frames_.push_back({&root_, nullptr, start_, 0});
+    }
+
+    ~CsqProfiler() {
+        report();
+    }
+
+    inline void enterLine(CsqLineStat* stat) {
+        uint64_t now = csqTicks();
+        if (current_ != nullptr) {
+            current_->ticks += now - last_;
+        }
+        stat->hits++;
+        current_ = stat;
+        line_ = stat->line;
+        last_ = now;
+    }
+
+    inline void enterFunction(CsqFunctionStat* fn) {
+        uint64_t now = csqTicks();
+        if (current_ != nullptr) {
+            current_->ticks += now - last_;
+        }
+        fn->calls++;
+        fn->active++;
+        frames_.push_back({frames_.back().node->child(fn), current_, now, 0});
+        current_ = nullptr;
+        last_ = csqTicks();
+    }
+
+    inline void exitFunction() {
+        uint64_t now = csqTicks();
+        if (current_ != nullptr) {
+            current_->ticks += now - last_;
+        }
+        CsqFrame frame = frames_.back();
+        frames_.pop_back();
+
+        uint64_t inclusive = now - frame.start;
+        CsqFunctionStat* fn = frame.node->fn;
+        // Recursive activations are already inside the outermost one
+        if (--fn->active == 0) {
+            fn->inclusive += inclusive;
+        }
+        fn->exclusive += inclusive - frame.childTicks;
+        frame.node->self += inclusive - frame.childTicks;
+        frames_.back().childTicks += inclusive;
+
+        current_ = frame.line;
+        line_ = current_ != nullptr ? current_->line : line_;
+        last_ = csqTicks();
+    }
+
+    void registerLine(CsqLineStat* stat) {
+        lines_.push_back(stat);
+    }
+
+    void registerFunction(CsqFunctionStat* fn) {
+        functions_.push_back(fn);
+    }
+
+private:
+    CsqFunctionStat mainStat_;
+    CsqCallNode root_;
+    std::vector<CsqFrame> frames_;
+    std::vector<CsqLineStat*> lines_;
+    std::vector<CsqFunctionStat*> functions_;
+    CsqLineStat* current_;
+    uint64_t start_;
+    uint64_t last_;
+    std::chrono::steady_clock::time_point startClock_;
+    double nsPerTick_ = 1.0;
+
+    double ms(uint64_t ticks) const {
+        return ticks * nsPerTick_ / 1e6;
+    }
+
+    static std::string sourceLine(const char* file, int line) {
+        std::ifstream source(file);
+        std::string text;
+        for (int i = 0; i < line && std::getline(source, text); i++) {
+        }
+        size_t begin = text.find_first_not_of(' ');
+        return begin == std::string::npos ? "" : text.substr(begin);
+    }
+
+    void folded(FILE* out, CsqCallNode* node, const std::string& path) {
+        std::string stack = path.empty() ? node->fn->name : path + ";" + node->fn->name;
+        uint64_t us = uint64_t(node->self * nsPerTick_ / 1e3);
+        if (us > 0) {
+            fprintf(out, "%s %llu\n", stack.c_str(), (unsigned long long)us);
+        }
+        for (CsqCallNode* child : node->children) {
+            folded(out, child, stack);
+        }
+    }
+
+    void report() {
+        uint64_t end = csqTicks();
+        if (current_ != nullptr) {
+            current_->ticks += end - last_;
+        }
+        while (frames_.size() > 1) {
+            exitFunction();
+        }
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startClock_).count();
+        if (end > start_) {
+            nsPerTick_ = elapsed / double(end - start_);
+        }
+        uint64_t total = end - start_;
+        mainStat_.inclusive = total;
+        mainStat_.exclusive = total - frames_.back().childTicks;
+        root_.self = mainStat_.exclusive;
+
+        size_t top = 20;
+        if (const char* env = getenv("CSQ_PROFILE_TOP")) {
+            top = size_t(atoi(env));
+        }
+
+        std::string base = CSQ_PROFILE_OUTPUT;
+        FILE* out = fopen((base + ".profile").c_str(), "w");
+        if (out != nullptr) {
+            fprintf(out, "Csq profile, total %.3f ms\n\n", ms(total));
+
+            std::vector<CsqLineStat*> lines = lines_;
+            std::sort(lines.begin(), lines.end(), [](CsqLineStat* a, CsqLineStat* b) { return a->ticks > b->ticks; });
+            fprintf(out, "Hot lines (top %zu by self time)\n", std::min(top, lines.size()));
+            fprintf(out, "%-24s %12s %12s %7s  %s\n", "line", "hits", "self ms", "%", "source");
+            for (size_t i = 0; i < lines.size() && i < top; i++) {
+                CsqLineStat* l = lines[i];
+                std::string file = l->file;
+                std::string where = file.substr(file.find_last_of('/') + 1) + ":" + std::to_string(l->line);
+                fprintf(out, "%-24s %12llu %12.3f %6.2f%%  %s\n", where.c_str(), (unsigned long long)l->hits,
+                        ms(l->ticks), total ? 100.0 * l->ticks / total : 0.0, sourceLine(l->file, l->line).c_str());
+            }
+
+            std::vector<CsqFunctionStat*> fns = functions_;
+            fns.insert(fns.begin(), &mainStat_);
+            std::sort(fns.begin(), fns.end(), [](CsqFunctionStat* a, CsqFunctionStat* b) { return a->inclusive > b->inclusive; });
+            fprintf(out, "\nFunctions\n");
+            fprintf(out, "%-24s %12s %14s %14s\n", "function", "calls", "inclusive ms", "exclusive ms");
+            for (CsqFunctionStat* fn : fns) {
+                fprintf(out, "%-24s %12llu %14.3f %14.3f\n", fn->name, (unsigned long long)fn->calls, ms(fn->inclusive),
+                        ms(fn->exclusive));
+            }
+            fclose(out);
+        }
+
+        out = fopen((base + ".folded").c_str(), "w");
+        if (out != nullptr) {
+            folded(out, &root_, "");
+            fclose(out);
+        }
+        fprintf(stderr, "csq: profile written to %s.profile and %s.folded\n", base.c_str(), base.c_str());
+    }
+};
+
+inline CsqProfiler& csqProfiler() {
+    static CsqProfiler profiler;
+    return profiler;
+}
+
+struct CsqLineSite {
+    CsqLineStat stat;
+    CsqLineSite(const char* file, int line) : stat{file, line, 0, 0} {
+        csqProfiler().registerLine(&stat);
+    }
+};
+
+struct CsqFunctionScope {
+    explicit CsqFunctionScope(CsqFunctionStat* fn) {
+        csqProfiler().enterFunction(fn);
+    }
+    ~CsqFunctionScope() {
+        csqProfiler().exitFunction();
+    }
+};
+
+struct CsqFunctionSite {
+    CsqFunctionStat stat;
+    explicit CsqFunctionSite(const char* name) : stat{name, 0, 0, 0, 0} {
+        csqProfiler().registerFunction(&stat);
+    }
+};
+
+#define CSQ_LINE(file, line)                             \
+    {                                                    \
+        static CsqLineSite __csq_line_site(file, line);  \
+        csqProfiler().enterLine(&__csq_line_site.stat);  \
+    }
+#define CSQ_FUNCTION(name)                                  \
+    static CsqFunctionSite __csq_function_site(name);       \
+    CsqFunctionScope __csq_function_scope(&__csq_function_site.stat)
+
+#else
+
+#define CSQ_LINE(file, line)
+#define CSQ_FUNCTION(name)
+
+#endif // CSQ_PROFILE
+
+#endif // PROFILE_CSQ4
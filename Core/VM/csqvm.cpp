@@ -0,0 +1,22 @@
+/*
+Entry point of the Csq VM used by `csq --run`.
+
+Usage: csqvm <file.csqb>
+*/
+#include "vm.h"
+
+// codes.h turns `main` into the prologue of generated programs
+#undef main
+#undef endmain
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: csqvm <file.csqb>\n");
+        return 1;
+    }
+    Program prog = loadProgram(argv[1]);
+    VM vm(prog);
+    vm.run();
+    freeMemory();
+    return 0;
+}
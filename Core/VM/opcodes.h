@@ -0,0 +1,63 @@
+#if !defined(VM_OPCODES_CSQ4)
+#define VM_OPCODES_CSQ4
+
+/*
+Instruction set of the Csq VM.
+
+Every instruction is 8 bytes wide: an opcode, a small count `n` and three
+16 bit operands a, b and c. Jump targets and 32 bit immediates use the pair
+(b, c) as a single value `bx`. R[x] is a register of the running function,
+G[x] a global (stored in `memory`) and K[x] an entry of the constant pool.
+
+The order of this list is the bytecode encoding, it must be kept in sync
+with Compiler/Bytecode/opcodes.py.
+*/
+#define CSQ_OPCODES(X)                                                  \
+    X(HALT)      /* stop the program                                 */ \
+    X(LOADI)     /* R[a] = bx                                        */ \
+    X(LOADK)     /* R[a] = K[b]                                      */ \
+    X(MOVE)      /* R[a] = R[b]                                      */ \
+    X(GETG)      /* R[a] = G[b]                                      */ \
+    X(SETG)      /* G[b] = R[a]                                      */ \
+    X(ADD)       /* R[a] = R[b] + R[c]                               */ \
+    X(SUB)       /* R[a] = R[b] - R[c]                               */ \
+    X(MUL)       /* R[a] = R[b] * R[c]                               */ \
+    X(DIV)       /* R[a] = R[b] / R[c]                               */ \
+    X(MOD)       /* R[a] = R[b] % R[c]                               */ \
+    X(EQ)        /* R[a] = R[b] == R[c]                              */ \
+    X(NE)        /* R[a] = R[b] != R[c]                              */ \
+    X(LT)        /* R[a] = R[b] < R[c]                               */ \
+    X(LE)        /* R[a] = R[b] <= R[c]                              */ \
+    X(GT)        /* R[a] = R[b] > R[c]                               */ \
+    X(GE)        /* R[a] = R[b] >= R[c]                              */ \
+    X(NOT)       /* R[a] = not R[b]                                  */ \
+    X(NEG)       /* R[a] = -R[b]                                     */ \
+    X(TRUTH)     /* R[a] = R[b] ? 1 : 0                              */ \
+    X(JMP)       /* pc = bx                                          */ \
+    X(JMPF)      /* if not R[a]: pc = bx                             */ \
+    X(JMPT)      /* if R[a]: pc = bx                                 */ \
+    X(LIST)      /* R[a] = {R[b], ..., R[b+c-1]}                     */ \
+    X(INDEX)     /* R[a] = R[b][R[c]]                                */ \
+    X(INDEXG)    /* R[a] = G[b][R[c]]                                */ \
+    X(SETINDEX)  /* R[a][R[b]] = R[c]                                */ \
+    X(SETINDEXG) /* G[a][R[b]] = R[c]                                */ \
+    X(FORPREP)   /* if not R[a] < R[a+1]: pc = bx                    */ \
+    X(FORLOOP)   /* R[a] += 1; if R[a] < R[a+1]: pc = bx             */ \
+    X(CALL)      /* R[a] = function b called with R[c..c+n-1]        */ \
+    X(BCALL)     /* R[a] = builtin b called with R[c..c+n-1]         */ \
+    X(RET)       /* return R[a]                                      */ \
+    X(RET0)      /* return 0                                         */ \
+    X(PRINT)     /* print(R[a])                                      */ \
+    X(ITERPREP)  /* start walking R[b] (G[b] if n), state R[a..a+4]  */ \
+    X(ITERNEXT)  /* R[a+4] = next value, skips the JMP after if any  */ \
+    X(GEN)       /* R[a] = generator of function b, R[c..c+n-1]      */ \
+    X(YIELD)     /* suspend the generator, giving R[a]               */
+
+enum OpCode : unsigned char {
+#define CSQ_OPCODE_ENUM(op) OP_##op,
+    CSQ_OPCODES(CSQ_OPCODE_ENUM)
+#undef CSQ_OPCODE_ENUM
+    OP_COUNT
+};
+
+#endif // VM_OPCODES_CSQ4
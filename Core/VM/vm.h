@@ -0,0 +1,785 @@
+#if !defined(VM_CSQ4)
+#define VM_CSQ4
+
+/*
+Csq VM
+
+Executes the register bytecode produced by Compiler/Bytecode/lowering.py.
+Values are the same `Cell`s used by the natively compiled code, globals are
+kept in `memory` (bound in SymTable) and builtins are the ones of basic.h,
+so both execution modes share the runtime.
+
+Dispatch is threaded through computed gotos when the compiler supports
+them (GCC, Clang), a plain switch is used otherwise or when CSQ_VM_SWITCH
+is defined.
+*/
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include "../Builtin/basic.h"
+#include "../Runtime/error.h"
+#include "opcodes.h"
+
+#if defined(__GNUC__) && !defined(CSQ_VM_SWITCH)
+#define CSQ_VM_THREADED 1
+#else
+#define CSQ_VM_THREADED 0
+#endif
+
+const char CSQ_BYTECODE_MAGIC[4] = {'C', 'S', 'Q', 'B'};
+const uint32_t CSQ_BYTECODE_VERSION = 2;
+// Csq calls don't recurse in C++ (see VMFrame), generators do: every generator
+// resumed from another one nests one more execute()
+const size_t CSQ_VM_MAX_DEPTH = 100000;
+const size_t CSQ_VM_MAX_NESTING = 2000;
+
+struct Instr {
+    uint8_t op;
+    uint8_t n;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+
+    // (b, c) read as a single 32 bit operand
+    inline int32_t bx() const {
+        return int32_t(uint32_t(b) | (uint32_t(c) << 16));
+    }
+};
+static_assert(sizeof(Instr) == 8, "Csq instructions are 8 bytes wide");
+
+using BuiltinFn = Cell (*)(Cell* args);
+
+struct Builtin {
+    BuiltinFn fn;
+    int arity;
+};
+
+struct Proto {
+    string name;
+    uint32_t nparams = 0;
+    uint32_t nregs = 0;
+    vector<Instr> code;
+};
+
+struct Program {
+    vector<Cell> consts;
+    vector<string> globals;
+    vector<string> builtinNames;
+    vector<Builtin> builtins;
+    vector<Proto> protos;
+};
+
+[[noreturn]] inline void vmError(const string& msg) {
+    RuntimeError("Csq RuntimeError: " + msg);
+    exit(1);
+}
+
+/*
+Builtins reachable from bytecode, they forward to basic.h. A builtin
+taking optional arguments has one more entry per arity, named name/arity.
+*/
+inline map<string, Builtin>& vmBuiltins() {
+    static map<string, Builtin> table = {
+        {"print", {[](Cell* a) { print(a[0]); return Cell(); }, 1}},
+        {"type", {[](Cell* a) { return type(a[0]); }, 1}},
+        {"len", {[](Cell* a) { return len(a[0]); }, 1}},
+        {"_push_elem", {[](Cell* a) { return _push_elem(a[0], a[1]); }, 2}},
+        {"_pop_elem", {[](Cell* a) { return _pop_elem(a[0]); }, 1}},
+        {"input", {[](Cell*) { return input(); }, 0}},
+        {"allocatedMemory", {[](Cell*) { return allocatedMemory(); }, 0}},
+        {"memstats", {[](Cell*) { return memstats(); }, 0}},
+        {"sort", {[](Cell* a) { return sort(a[0]); }, 1}},
+        {"sort/2", {[](Cell* a) { return sort(a[0], a[1]); }, 2}},
+        {"argsort", {[](Cell* a) { return argsort(a[0]); }, 1}},
+        {"argsort/2", {[](Cell* a) { return argsort(a[0], a[1]); }, 2}},
+        {"range", {[](Cell* a) { return range(a[0], a[1]); }, 2}},
+        {"range/3", {[](Cell* a) { return range(a[0], a[1], a[2]); }, 3}},
+        {"collect", {[](Cell* a) { return collect(a[0]); }, 1}},
+        {"split", {[](Cell* a) { return split(a[0]); }, 1}},
+        {"split/2", {[](Cell* a) { return split(a[0], a[1]); }, 2}},
+        {"find", {[](Cell* a) { return find(a[0], a[1]); }, 2}},
+        {"count", {[](Cell* a) { return count(a[0], a[1]); }, 2}},
+        {"replace", {[](Cell* a) { return replace(a[0], a[1], a[2]); }, 3}},
+        {"strip", {[](Cell* a) { return strip(a[0]); }, 1}},
+        {"lower", {[](Cell* a) { return lower(a[0]); }, 1}},
+        {"upper", {[](Cell* a) { return upper(a[0]); }, 1}},
+        {"startswith", {[](Cell* a) { return startswith(a[0], a[1]); }, 2}},
+    };
+    return table;
+}
+
+/*
+Bytecode loading
+*/
+
+class BytecodeReader {
+public:
+    explicit BytecodeReader(const string& data) : data_(data), pos_(0) {}
+
+    template <typename T>
+    T read() {
+        if (pos_ + sizeof(T) > data_.size()) {
+            vmError("truncated bytecode file");
+        }
+        T value;
+        memcpy(&value, data_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+
+    // Number of entries of at least minSize bytes each, bounded by what is left of the file
+    uint32_t readCount(size_t minSize) {
+        uint32_t count = read<uint32_t>();
+        if (count > (data_.size() - pos_) / minSize) {
+            vmError("truncated bytecode file");
+        }
+        return count;
+    }
+
+    string readString() {
+        uint32_t size = read<uint32_t>();
+        if (pos_ + size > data_.size()) {
+            vmError("truncated bytecode file");
+        }
+        string value = data_.substr(pos_, size);
+        pos_ += size;
+        return value;
+    }
+
+private:
+    const string& data_;
+    size_t pos_;
+};
+
+// Points a builtin call to the name/arity entry matching its number of arguments
+inline void bindOverload(Program& prog, Instr& instr) {
+    string name = prog.builtinNames[instr.b] + "/" + to_string(instr.n);
+    for (size_t i = 0; i < prog.builtinNames.size(); i++) {
+        if (prog.builtinNames[i] == name) {
+            instr.b = uint16_t(i);
+            return;
+        }
+    }
+    auto it = vmBuiltins().find(name);
+    if (it != vmBuiltins().end()) {
+        instr.b = uint16_t(prog.builtins.size());
+        prog.builtinNames.push_back(name);
+        prog.builtins.push_back(it->second);
+    }
+}
+
+// Operands of every instruction: registers within nregs, constants, globals and jump targets in range
+inline void validateProto(const Program& prog, const Proto& proto) {
+    if (proto.nregs > 0x10000 || proto.nparams > proto.nregs || proto.code.empty()) {
+        vmError("invalid function '" + proto.name + "'");
+    }
+    // Every function ends with a return, HALT or a jump back, the loop never runs past the code
+    uint8_t last = proto.code.back().op;
+    if (last != OP_RET0 && last != OP_RET && last != OP_HALT && last != OP_JMP) {
+        vmError("invalid end of '" + proto.name + "'");
+    }
+    auto regs = [&](size_t first, size_t count) { return first + count <= proto.nregs; };
+    auto global = [&](size_t slot) { return slot < prog.globals.size(); };
+    for (size_t pc = 0; pc < proto.code.size(); pc++) {
+        const Instr& in = proto.code[pc];
+        bool jumps = in.op == OP_JMP || in.op == OP_JMPF || in.op == OP_JMPT || in.op == OP_FORPREP || in.op == OP_FORLOOP;
+        bool ok = !jumps || (in.bx() >= 0 && size_t(in.bx()) < proto.code.size());
+        switch (in.op) {
+            case OP_HALT:
+            case OP_RET0:
+            case OP_JMP:
+                break;
+            case OP_LOADI:
+            case OP_JMPF:
+            case OP_JMPT:
+            case OP_RET:
+            case OP_PRINT:
+            case OP_YIELD:
+                ok = ok && regs(in.a, 1);
+                break;
+            case OP_LOADK:
+                ok = ok && regs(in.a, 1) && in.b < prog.consts.size();
+                break;
+            case OP_GETG:
+            case OP_SETG:
+                ok = ok && regs(in.a, 1) && global(in.b);
+                break;
+            case OP_MOVE:
+            case OP_NOT:
+            case OP_NEG:
+            case OP_TRUTH:
+                ok = ok && regs(in.a, 1) && regs(in.b, 1);
+                break;
+            case OP_LIST:
+                ok = ok && regs(in.a, 1) && regs(in.b, in.c);
+                break;
+            case OP_INDEXG:
+                ok = ok && regs(in.a, 1) && global(in.b) && regs(in.c, 1);
+                break;
+            case OP_SETINDEXG:
+                ok = ok && global(in.a) && regs(in.b, 1) && regs(in.c, 1);
+                break;
+            case OP_FORPREP:
+            case OP_FORLOOP:
+                ok = ok && regs(in.a, 2);
+                break;
+            case OP_CALL:
+            case OP_BCALL:
+            case OP_GEN:
+                ok = ok && regs(in.a, 1) && regs(in.c, in.n);
+                break;
+            case OP_ITERPREP:
+                ok = ok && regs(in.a, 5) && (in.n ? global(in.b) : regs(in.b, 1));
+                break;
+            case OP_ITERNEXT:
+                // Skips the instruction after it, which can't be the last one
+                ok = ok && regs(in.a, 5) && pc + 2 < proto.code.size();
+                break;
+            default:
+                if (in.op >= OP_COUNT) {
+                    vmError("invalid opcode in '" + proto.name + "'");
+                }
+                // The three operand arithmetic, comparison and indexing instructions
+                ok = ok && regs(in.a, 1) && regs(in.b, 1) && regs(in.c, 1);
+                break;
+        }
+        if (!ok) {
+            vmError("invalid operands in '" + proto.name + "'");
+        }
+    }
+}
+
+inline Program loadProgram(const string& path) {
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) {
+        vmError("couldn't open bytecode file '" + path + "'");
+    }
+    string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    BytecodeReader in(data);
+
+    char magic[4];
+    for (char& ch : magic) {
+        ch = in.read<char>();
+    }
+    if (memcmp(magic, CSQ_BYTECODE_MAGIC, 4) != 0) {
+        vmError("'" + path + "' is not a Csq bytecode file");
+    }
+    if (in.read<uint32_t>() != CSQ_BYTECODE_VERSION) {
+        vmError("'" + path + "' was produced by another version of csq");
+    }
+
+    Program prog;
+    uint32_t count = in.readCount(5);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t tag = in.read<uint8_t>();
+        if (tag == 1) {
+            prog.consts.push_back(Cell(in.read<double>()));
+        } else {
+            prog.consts.push_back(Cell(in.readString()));
+        }
+    }
+
+    count = in.readCount(4);
+    for (uint32_t i = 0; i < count; i++) {
+        prog.globals.push_back(in.readString());
+    }
+
+    count = in.readCount(4);
+    for (uint32_t i = 0; i < count; i++) {
+        string name = in.readString();
+        auto it = vmBuiltins().find(name);
+        if (it == vmBuiltins().end()) {
+            vmError("undefined function '" + name + "'");
+        }
+        prog.builtinNames.push_back(name);
+        prog.builtins.push_back(it->second);
+    }
+
+    count = in.readCount(16);
+    prog.protos.resize(count);
+    for (Proto& proto : prog.protos) {
+        proto.name = in.readString();
+        proto.nparams = in.read<uint32_t>();
+        proto.nregs = in.read<uint32_t>();
+        proto.code.resize(in.readCount(sizeof(Instr)));
+        for (Instr& instr : proto.code) {
+            instr = in.read<Instr>();
+        }
+    }
+
+    // Validate once so that the interpreter loop doesn't have to
+    for (Proto& proto : prog.protos) {
+        validateProto(prog, proto);
+        for (Instr& instr : proto.code) {
+            if ((instr.op == OP_CALL || instr.op == OP_GEN) && (instr.b >= prog.protos.size() || instr.n != prog.protos[instr.b].nparams)) {
+                vmError("invalid call in '" + proto.name + "'");
+            }
+            if (instr.op == OP_BCALL && instr.b >= prog.builtins.size()) {
+                vmError("invalid builtin call in '" + proto.name + "'");
+            }
+            if (instr.op == OP_BCALL && instr.n != prog.builtins[instr.b].arity) {
+                bindOverload(prog, instr);
+            }
+            if (instr.op == OP_BCALL && instr.n != prog.builtins[instr.b].arity) {
+                vmError("wrong number of arguments for '" + prog.builtinNames[instr.b] + "'");
+            }
+        }
+    }
+    if (prog.protos.empty()) {
+        vmError("bytecode file has no code");
+    }
+    return prog;
+}
+
+// Registers are written with csqBind (Runtime/iterator.h), which releases their previous value
+
+inline bool truthy(const Cell& c) {
+    return bool(c);
+}
+
+inline const Cell& vmIndex(const Cell& list, const Cell& index) {
+    if (list.type != Type::COMPOUND) {
+        vmError("only compounds can be indexed");
+    }
+    int i = index.type == Type::FLOAT ? int(index.floatVal) : index.intVal;
+    if (i < 0 || size_t(i) >= list.vectorVal->size()) {
+        vmError("index " + to_string(i) + " out of range");
+    }
+    return (*list.vectorVal)[i];
+}
+
+inline void vmSetIndex(Cell& list, const Cell& index, const Cell& val) {
+    csqBind(const_cast<Cell&>(vmIndex(list, index)), val);
+}
+
+inline int vmInt(const Cell& c) {
+    return c.type == Type::FLOAT ? int(c.floatVal) : c.intVal;
+}
+
+class VM;
+
+/*
+Generator: a function containing `yield` called by GEN. It runs on its own
+register stack and resumes at the instruction following its last YIELD.
+*/
+struct VMGenerator : CsqIterator {
+    VM& vm;
+    const Proto& proto;
+    vector<Cell> stack;
+    size_t pc = 0;
+    bool running = false;
+    bool done = false;
+
+    VMGenerator(VM& vm_, const Proto& proto_, const Cell* args) : vm(vm_), proto(proto_), stack(proto_.nregs + 1) {
+        for (uint32_t i = 0; i < proto.nparams; i++) {
+            stack[i] = args[i];
+        }
+    }
+
+    bool next(Cell& out) override;
+
+    string name() const override {
+        return "generator";
+    }
+};
+
+// Caller suspended by CALL, RET continues it at ip with the result in R[ip[-1].a]
+struct VMFrame {
+    const Proto* fn;
+    size_t base;
+    const Instr* ip;
+};
+
+class VM {
+public:
+    explicit VM(Program& prog) : prog_(prog), stack_(&mainStack_), depth_(0) {
+        memory.reserve(prog_.globals.size());
+        for (const string& name : prog_.globals) {
+            allocateVar(name, Cell());
+        }
+        mainStack_.resize(1024);
+    }
+
+    void run() {
+        execute(prog_.protos[0], 0);
+    }
+
+    bool resume(VMGenerator& gen, Cell& out);
+
+private:
+    Program& prog_;
+    vector<Cell> mainStack_;
+    // Stack of the running code: mainStack_ or the one of a generator
+    vector<Cell>* stack_;
+    size_t depth_;
+    // Callers of every running execute(), each one only pops the frames it pushed
+    vector<VMFrame> frames_;
+    size_t nesting_ = 0;
+    // Set by YIELD (and cleared by returns) for resume()
+    bool yielded_ = false;
+    size_t yieldPc_ = 0;
+
+    Cell execute(const Proto& fn, size_t base, size_t pc = 0);
+};
+
+inline bool VMGenerator::next(Cell& out) {
+    return vm.resume(*this, out);
+}
+
+inline bool VM::resume(VMGenerator& gen, Cell& out) {
+    if (gen.done) {
+        return false;
+    }
+    if (gen.running) {
+        vmError("generator '" + gen.proto.name + "' is already running");
+    }
+    gen.running = true;
+    vector<Cell>* caller = stack_;
+    stack_ = &gen.stack;
+    Cell value = execute(gen.proto, 0, gen.pc);
+    stack_ = caller;
+    gen.running = false;
+
+    if (!yielded_) {
+        gen.done = true;
+        vector<Cell>().swap(gen.stack);
+        return false;
+    }
+    gen.pc = yieldPc_;
+    csqBind(out, std::move(value));
+    return true;
+}
+
+inline Cell VM::execute(const Proto& entry, size_t base, size_t pc) {
+    if (++depth_ > CSQ_VM_MAX_DEPTH || nesting_ >= CSQ_VM_MAX_NESTING) {
+        vmError("maximum recursion depth exceeded in '" + entry.name + "'");
+    }
+    if (base + entry.nregs + 1 > stack_->size()) {
+        stack_->resize((base + entry.nregs + 1) * 2);
+    }
+    nesting_++;
+    const size_t entryFrames = frames_.size();
+
+    const Proto* fn = &entry;
+    Cell* R = stack_->data() + base;
+    const Instr* code = fn->code.data();
+    const Instr* ip = code + pc;
+    const Cell* K = prog_.consts.data();
+
+#if CSQ_VM_THREADED
+#define CSQ_OPCODE_LABEL(op) &&L_##op,
+    static const void* labels[] = {CSQ_OPCODES(CSQ_OPCODE_LABEL)};
+#undef CSQ_OPCODE_LABEL
+#define CASE(op) L_##op:
+#define DISPATCH() goto *labels[ip->op]
+#else
+#define CASE(op) case OP_##op:
+#define DISPATCH() goto dispatch
+#endif
+
+#define ARITH(opname, op)                                                      \
+    CASE(opname) {                                                             \
+        const Instr in = *ip++;                                                \
+        const Cell& x = R[in.b];                                               \
+        const Cell& y = R[in.c];                                               \
+        if (x.type == Type::INT && y.type == Type::INT) {                      \
+            csqBind(R[in.a], x.intVal op y.intVal);                             \
+        } else if (x.type == Type::FLOAT && y.type == Type::FLOAT) {           \
+            csqBind(R[in.a], Cell(x.floatVal op y.floatVal));                  \
+        } else {                                                               \
+            csqBind(R[in.a], x op y);                                          \
+        }                                                                      \
+        DISPATCH();                                                            \
+    }
+
+// Leaves the running function: back to the caller frame, or out of execute()
+// when the function is the one it was entered with
+#define RETURN(value)                                                          \
+    {                                                                          \
+        Cell result = value;                                                   \
+        depth_--;                                                              \
+        if (frames_.size() == entryFrames) {                                   \
+            nesting_--;                                                        \
+            yielded_ = false;                                                  \
+            return result;                                                     \
+        }                                                                      \
+        const VMFrame& caller = frames_.back();                                \
+        fn = caller.fn;                                                        \
+        base = caller.base;                                                    \
+        ip = caller.ip;                                                        \
+        frames_.pop_back();                                                    \
+        code = fn->code.data();                                                \
+        R = stack_->data() + base;                                             \
+        csqBind(R[ip[-1].a], std::move(result));                               \
+        DISPATCH();                                                            \
+    }
+
+#define COMPARE(opname, op)                                                    \
+    CASE(opname) {                                                             \
+        const Instr in = *ip++;                                                \
+        const Cell& x = R[in.b];                                               \
+        const Cell& y = R[in.c];                                               \
+        if (x.type == Type::INT && y.type == Type::INT) {                      \
+            csqBind(R[in.a], x.intVal op y.intVal);                             \
+        } else if (x.type == Type::FLOAT && y.type == Type::FLOAT) {           \
+            csqBind(R[in.a], x.floatVal op y.floatVal);                         \
+        } else {                                                               \
+            csqBind(R[in.a], x op y);                                           \
+        }                                                                      \
+        DISPATCH();                                                            \
+    }
+
+    DISPATCH();
+#if !CSQ_VM_THREADED
+dispatch:
+    switch (ip->op) {
+#endif
+    CASE(HALT) {
+        depth_--;
+        nesting_--;
+        yielded_ = false;
+        return Cell();
+    }
+    CASE(LOADI) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], in.bx());
+        DISPATCH();
+    }
+    CASE(LOADK) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], K[in.b]);
+        DISPATCH();
+    }
+    CASE(MOVE) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], R[in.b]);
+        DISPATCH();
+    }
+    CASE(GETG) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], memory[in.b]);
+        DISPATCH();
+    }
+    CASE(SETG) {
+        const Instr in = *ip++;
+        csqBind(memory[in.b], R[in.a]);
+        DISPATCH();
+    }
+    CASE(DIV) {
+        const Instr in = *ip++;
+        const Cell& x = R[in.b];
+        const Cell& y = R[in.c];
+        if (x.type == Type::INT && y.type == Type::INT && y.intVal != 0) {
+            csqBind(R[in.a], x.intVal / y.intVal);
+        } else {
+            csqBind(R[in.a], x / y);
+        }
+        DISPATCH();
+    }
+    CASE(MOD) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], R[in.b] % R[in.c]);
+        DISPATCH();
+    }
+    ARITH(ADD, +)
+    ARITH(SUB, -)
+    ARITH(MUL, *)
+    COMPARE(EQ, ==)
+    COMPARE(NE, !=)
+    COMPARE(LT, <)
+    COMPARE(LE, <=)
+    COMPARE(GT, >)
+    COMPARE(GE, >=)
+    CASE(NOT) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], !truthy(R[in.b]));
+        DISPATCH();
+    }
+    CASE(NEG) {
+        const Instr in = *ip++;
+        const Cell& x = R[in.b];
+        if (x.type == Type::INT) {
+            csqBind(R[in.a], -x.intVal);
+        } else {
+            csqBind(R[in.a], Cell(0) - x);
+        }
+        DISPATCH();
+    }
+    CASE(TRUTH) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], truthy(R[in.b]));
+        DISPATCH();
+    }
+    CASE(JMP) {
+        ip = code + ip->bx();
+        DISPATCH();
+    }
+    CASE(JMPF) {
+        const Instr in = *ip++;
+        if (!truthy(R[in.a])) {
+            ip = code + in.bx();
+        }
+        DISPATCH();
+    }
+    CASE(JMPT) {
+        const Instr in = *ip++;
+        if (truthy(R[in.a])) {
+            ip = code + in.bx();
+        }
+        DISPATCH();
+    }
+    CASE(LIST) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], Cell(vector<Cell>(R + in.b, R + in.b + in.c)));
+        DISPATCH();
+    }
+    CASE(INDEX) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], vmIndex(R[in.b], R[in.c]));
+        DISPATCH();
+    }
+    CASE(INDEXG) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], vmIndex(memory[in.b], R[in.c]));
+        DISPATCH();
+    }
+    CASE(SETINDEX) {
+        const Instr in = *ip++;
+        vmSetIndex(R[in.a], R[in.b], R[in.c]);
+        DISPATCH();
+    }
+    CASE(SETINDEXG) {
+        const Instr in = *ip++;
+        vmSetIndex(memory[in.a], R[in.b], R[in.c]);
+        DISPATCH();
+    }
+    CASE(FORPREP) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], vmInt(R[in.a]));
+        csqBind(R[in.a + 1], vmInt(R[in.a + 1]));
+        if (!(R[in.a].intVal < R[in.a + 1].intVal)) {
+            ip = code + in.bx();
+        }
+        DISPATCH();
+    }
+    CASE(FORLOOP) {
+        const Instr in = *ip++;
+        if (++R[in.a].intVal < R[in.a + 1].intVal) {
+            ip = code + in.bx();
+        }
+        DISPATCH();
+    }
+    CASE(CALL) {
+        const Instr in = *ip++;
+        const Proto& callee = prog_.protos[in.b];
+        if (++depth_ > CSQ_VM_MAX_DEPTH) {
+            vmError("maximum recursion depth exceeded in '" + callee.name + "'");
+        }
+        frames_.push_back({fn, base, ip});
+        fn = &callee;
+        base += in.c;
+        if (base + fn->nregs + 1 > stack_->size()) {
+            stack_->resize((base + fn->nregs + 1) * 2);
+        }
+        R = stack_->data() + base;
+        code = fn->code.data();
+        ip = code;
+        DISPATCH();
+    }
+    CASE(BCALL) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], prog_.builtins[in.b].fn(R + in.c));
+        DISPATCH();
+    }
+    CASE(RET) {
+        RETURN(R[ip->a]);
+    }
+    CASE(RET0) {
+        RETURN(Cell());
+    }
+    CASE(PRINT) {
+        const Instr in = *ip++;
+        print(R[in.a]);
+        DISPATCH();
+    }
+    /*
+    for loops over values keep their state in R[a..a+4]: the kind of walk
+    (0 compound, 1 range, 2 iterator), the position, the end of a range or
+    the iterator, the step of a range and the value. The compound is read in
+    place from R[b] (or G[b] when n is set), ITERNEXT skips the JMP leaving
+    the loop which follows it as long as there are values.
+    */
+    CASE(ITERPREP) {
+        const Instr in = *ip++;
+        const Cell& src = in.n ? memory[in.b] : R[in.b];
+        if (src.type == Type::COMPOUND) {
+            csqBind(R[in.a], 0);
+            csqBind(R[in.a + 1], 0);
+        } else if (src.type == Type::ITERATOR) {
+            if (const CsqRange* range = dynamic_cast<const CsqRange*>(src.iterVal)) {
+                int start = range->start, stop = range->stop, step = range->step;
+                csqBind(R[in.a], 1);
+                csqBind(R[in.a + 1], start);
+                csqBind(R[in.a + 2], stop);
+                csqBind(R[in.a + 3], step);
+            } else {
+                Cell cursor(src.iterVal->iterate());
+                csqBind(R[in.a], 2);
+                csqBind(R[in.a + 2], std::move(cursor));
+            }
+        } else {
+            vmError("for loops can only iterate over compounds, ranges and generators");
+        }
+        DISPATCH();
+    }
+    CASE(ITERNEXT) {
+        const Instr in = *ip++;
+        Cell* S = R + in.a;
+        if (S[0].intVal == 0) {
+            const Cell& src = in.n ? memory[in.b] : R[in.b];
+            if (src.type == Type::COMPOUND && size_t(S[1].intVal) < src.vectorVal->size()) {
+                csqBind(S[4], (*src.vectorVal)[S[1].intVal++]);
+                ip++;
+            }
+        } else if (S[0].intVal == 1) {
+            int current = S[1].intVal;
+            if (S[3].intVal > 0 ? current < S[2].intVal : current > S[2].intVal) {
+                csqBind(S[4], current);
+                S[1].intVal = current + S[3].intVal;
+                ip++;
+            }
+        } else if (S[2].iterVal->next(S[4])) {
+            ip++;
+        }
+        DISPATCH();
+    }
+    CASE(GEN) {
+        const Instr in = *ip++;
+        csqBind(R[in.a], Cell(new VMGenerator(*this, prog_.protos[in.b], R + in.c)));
+        DISPATCH();
+    }
+    CASE(YIELD) {
+        const Instr in = *ip++;
+        depth_--;
+        nesting_--;
+        yielded_ = true;
+        yieldPc_ = ip - code;
+        return R[in.a];
+    }
+#if !CSQ_VM_THREADED
+    default:
+        vmError("invalid opcode");
+    }
+#endif
+
+#undef ARITH
+#undef RETURN
+#undef COMPARE
+#undef CASE
+#undef DISPATCH
+}
+
+#endif // VM_CSQ4
@@ -0,0 +1,259 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""
+Csq benchmark suite
+
+Compiles every benchmark of this directory natively (g++) and/or lowers it
+for the VM, runs it on generated data and reports wall time, throughput and
+peak RSS as JSON so runtime versions can be compared.
+
+Usage: ./build.sh bench [--mode native|vm|all] [--repeat N] [--filter NAME] [--output FILE]
+"""
+
+import argparse
+import json
+import os
+import platform
+import resource
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from contextlib import redirect_stdout
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+CSQ_DIR = os.path.dirname(BENCH_DIR)
+sys.path.insert(0, CSQ_DIR)
+
+from Compiler import utils
+from Compiler.Bytecode.lowering import Lower
+from Compiler.code_format import readCode, toTokens, writeBytecode, writeCode
+from Compiler.Compiletime import stack
+from Compiler.Compiletime.wrapper import bind
+from Compiler.Parser import parserTokenToNode
+from Compiler.Parser.parser import Compile
+from csq import VERSION, findVM
+
+CSV_ROWS = 200000
+TEXT_LINES = 500000
+
+"""
+Benchmarks: file, number of operations (loop iterations, calls, rows) the
+throughput is computed from and the modes able to run it (recursion needs
+the VM, classes and cimport need the native compilation).
+"""
+BENCHMARKS = [
+    {"name": "arith", "file": "arith.csq", "ops": 10000000, "modes": ["native", "vm"]},
+    {"name": "float", "file": "float.csq", "ops": 10000000, "modes": ["native", "vm"]},
+    {"name": "recursion", "file": "recursion.csq", "ops": 635621, "modes": ["vm"]},
+    {"name": "list", "file": "list.csq", "ops": 1004250, "modes": ["native", "vm"]},
+    {"name": "strings", "file": "strings.csq", "ops": 20000, "modes": ["native", "vm"]},
+    {"name": "classes", "file": "classes.csq", "ops": 1000000, "modes": ["native"]},
+    {"name": "csv", "file": "csv.csq", "ops": CSV_ROWS, "modes": ["native"]},
+    {"name": "lines", "file": "lines.csq", "ops": TEXT_LINES, "modes": ["native"]},
+    {"name": "text", "file": "text.csq", "ops": TEXT_LINES, "modes": ["native"]},
+    {"name": "helpers", "file": "helpers.csq", "ops": 402200, "modes": ["native", "vm"]},
+]
+
+
+def generateData(workdir):
+    """Write the input files read by the csv, lines and text benchmarks."""
+    with open(os.path.join(workdir, "bench_data.csv"), "w") as data:
+        for i in range(CSV_ROWS):
+            data.write(f'{i},{i * 0.25},"row{i % 97}"\n')
+    with open(os.path.join(workdir, "bench_lines.txt"), "w") as data:
+        for i in range(TEXT_LINES):
+            data.write(f"{i} GET /api/v1/items/{i % 1000} 200 {i % 317}ms\n")
+
+
+def includeDir(workdir):
+    """Cimport modules include <Csq/Core/...>, expose the tree under that name."""
+    include = os.path.join(workdir, "include")
+    os.makedirs(include, exist_ok=True)
+    link = os.path.join(include, "Csq")
+    if not os.path.exists(link):
+        os.symlink(CSQ_DIR, link)
+    return include
+
+
+def resetCompiler():
+    """
+    Forget what the previous benchmark declared, the compiler keeps its state in
+    module globals made for one file per process. The lists and dictionaries are
+    imported by name elsewhere, so they are emptied in place.
+    """
+    parserTokenToNode.line_no = 1
+    stack.Compiletime_Objects.clear()
+    stack.Native_Functions.clear()
+    stack.hasCimport = False
+    utils.error_list.clear()
+
+
+def buildNative(source, workdir, flags):
+    """Compile a benchmark with g++, returns the binary and the build time."""
+    name = os.path.splitext(os.path.basename(source))[0]
+    cpp_file = os.path.join(workdir, name + ".cpp")
+    binary = os.path.join(workdir, name)
+
+    start = time.perf_counter()
+    resetCompiler()
+    with redirect_stdout(sys.stderr):
+        writeCode(bind(CSQ_DIR, Compile(toTokens(readCode(source)))), cpp_file)
+    command = ["g++"] + flags.split() + ["-I", includeDir(workdir), "-o", binary, cpp_file]
+    if subprocess.call(command) != 0:
+        raise RuntimeError("failed to compile " + source)
+    return [binary], time.perf_counter() - start
+
+
+def buildVM(source, workdir, vm):
+    """Lower a benchmark to bytecode, returns the VM command and the lowering time."""
+    name = os.path.splitext(os.path.basename(source))[0]
+    bytecode_file = os.path.join(workdir, name + ".csqb")
+
+    start = time.perf_counter()
+    with redirect_stdout(sys.stderr):
+        writeBytecode(Lower(readCode(source), CSQ_DIR), bytecode_file)
+    return [vm, bytecode_file], time.perf_counter() - start
+
+
+def readHighWaterMark(pid):
+    """Peak RSS (KiB) of a running process, 0 once it's gone."""
+    try:
+        with open(f"/proc/{pid}/status") as status:
+            for line in status:
+                if line.startswith("VmHWM:"):
+                    return int(line.split()[1])
+    except (OSError, ValueError):
+        pass
+    return 0
+
+
+def measure(command, workdir):
+    """
+    Run a command once, returns wall time, peak RSS (KiB) and its last line of output.
+
+    Linux carries the RSS of the parent into the ru_maxrss of its children, so
+    ru_maxrss is only exact when the benchmark grows past the runner itself.
+    Below that the high-water mark sampled from /proc is reported instead.
+    """
+    floor = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    sampled = [0]
+    done = threading.Event()
+
+    with tempfile.TemporaryFile() as output:
+        start = time.perf_counter()
+        proc = subprocess.Popen(command, cwd=workdir, stdout=output, stderr=subprocess.DEVNULL)
+
+        def sample():
+            while not done.wait(0.005):
+                sampled[0] = max(sampled[0], readHighWaterMark(proc.pid))
+
+        sampler = threading.Thread(target=sample)
+        sampler.start()
+        _, status, usage = os.wait4(proc.pid, 0)
+        wall = time.perf_counter() - start
+        done.set()
+        sampler.join()
+        proc.returncode = os.waitstatus_to_exitcode(status)
+
+        output.seek(0)
+        lines = output.read().decode(errors="replace").strip().split("\n")
+
+    if proc.returncode != 0:
+        raise RuntimeError(f"{' '.join(command)} exited with {proc.returncode}")
+    peak_rss = usage.ru_maxrss if usage.ru_maxrss > floor else sampled[0]
+    return wall, peak_rss, lines[-1]
+
+
+def compilerVersion():
+    try:
+        return subprocess.check_output(["g++", "--version"], text=True).split("\n")[0]
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Csq benchmark suite")
+    parser.add_argument("--mode", choices=["native", "vm", "all"], default="all")
+    parser.add_argument("--repeat", type=int, default=3, help="Runs per benchmark")
+    parser.add_argument("--filter", help="Only run benchmarks whose name contains this")
+    parser.add_argument("--flags", default="-std=c++20 -O2 -pthread", help="g++ flags for native builds")
+    parser.add_argument("--output", help="Write the JSON report to this file")
+    args = parser.parse_args()
+
+    os.environ["CSQ_INCLUDE"] = CSQ_DIR
+    modes = ["native", "vm"] if args.mode == "all" else [args.mode]
+    workdir = tempfile.mkdtemp(prefix="csq-bench-")
+    try:
+        generateData(workdir)
+
+        vm = None
+        if "vm" in modes:
+            with redirect_stdout(sys.stderr):
+                vm = findVM(CSQ_DIR)
+            if vm is None:
+                print("Error: csq VM not found", file=sys.stderr)
+                exit(1)
+
+        results = []
+        for bench in BENCHMARKS:
+            if args.filter and args.filter not in bench["name"]:
+                continue
+            source = os.path.join(BENCH_DIR, bench["file"])
+            for mode in modes:
+                if mode not in bench["modes"]:
+                    continue
+                print(f"{bench['name']} ({mode})", file=sys.stderr)
+                if mode == "native":
+                    command, build_time = buildNative(source, workdir, args.flags)
+                else:
+                    command, build_time = buildVM(source, workdir, vm)
+
+                walls = []
+                peak_rss = 0
+                result = ""
+                for _ in range(args.repeat):
+                    wall, rss, result = measure(command, workdir)
+                    walls.append(wall)
+                    peak_rss = max(peak_rss, rss)
+
+                wall = statistics.median(walls)
+                results.append({
+                    "name": bench["name"],
+                    "mode": mode,
+                    "ops": bench["ops"],
+                    "build_s": round(build_time, 6),
+                    "wall_s": round(wall, 6),
+                    "wall_min_s": round(min(walls), 6),
+                    "throughput_ops_s": round(bench["ops"] / wall, 1),
+                    "peak_rss_kb": peak_rss,
+                    "result": result,
+                })
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    report = {
+        "csq_version": VERSION,
+        "compiler": compilerVersion(),
+        "flags": args.flags,
+        "machine": platform.machine(),
+        "python": platform.python_version(),
+        "repeat": args.repeat,
+        "timestamp": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+        "benchmarks": results,
+    }
+
+    text = json.dumps(report, indent=2)
+    if args.output:
+        with open(args.output, "w") as out:
+            out.write(text + "\n")
+    else:
+        print(text)
+
+
+if __name__ == "__main__":
+    main()
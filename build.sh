@@ -26,9 +26,20 @@ can_write() {
     [ -w "$1" ]
 }
 
+# Build the bytecode VM used by `csq --run`, it is shipped along with Core
+function build_vm() {
+    if command -v g++ > /dev/null; then
+        echo "Building the Csq VM"
+        g++ -std=c++20 -O2 -pthread -o Core/VM/csqvm Core/VM/csqvm.cpp
+    else
+        echo "g++ not found, the Csq VM will be built on its first use"
+    fi
+}
+
 function install() {
 	# Make the csq.py executable before doing anything
 	chmod +x csq.py
+    build_vm
     if is_root || can_write "/opt"; then
         echo "I'll install csq in /opt/csq and create a symlink to /usr/local/bin/csq"
         mkdir -p /opt/csq
@@ -110,7 +121,9 @@ if [ "$1" == "install" ] || [ "$1" == "-i" ]; then
 	install
 elif [ "$1" == "uninstall" ] || [ "$1" == "-u" ]; then
 	uninstall
+elif [ "$1" == "bench" ] || [ "$1" == "-b" ]; then
+	python3 bench/run.py "${@:2}"
 else
-	echo "Usage: build.sh <install|uninstall>"
+	echo "Usage: build.sh <install|uninstall|bench>"
 fi
 
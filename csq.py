@@ -2,15 +2,20 @@
 # -*- coding: utf-8 -*-
 
 import argparse
-from os import access
+import subprocess
+import tempfile
+from glob import glob
+from os import access, makedirs
 from os import getcwd as pwd
-from os import getenv, getuid, path, system
+from os import W_OK, environ, getenv, getuid, path, remove, system
 from sys import argv as arguments
 from sys import version_info
 
-from Compiler.code_format import readCode, toTokens, writeCode
+from Compiler.Bytecode.lowering import Lower
+from Compiler.code_format import readCode, toTokens, writeBytecode, writeCode
 from Compiler.Compiletime.wrapper import bind
 from Compiler.Parser.parser import Compile
+from Compiler import utils
 
 VERSION = "4.3"
 
@@ -95,10 +100,12 @@ def findIncludePath():
     return None
 
 
-def compileFile(file, options, keep=False):
+def compileFile(file, options, keep=False, profile=False, memstats=False):
     """Compile the code in a file
     The function takes in a file as string and compiles it.
     The compiled code is stored in a file with the same name
+    With profile the program writes <name>.profile and <name>.folded on exit
+    With memstats the program prints its allocation counters on exit
     """
     # csq include path path
     csq_include_path = findIncludePath()
@@ -107,6 +114,9 @@ def compileFile(file, options, keep=False):
         print("Error: csq include path not found")
         exit(1)
 
+    # Imports are resolved from CSQ_INCLUDE
+    environ.setdefault("CSQ_INCLUDE", csq_include_path)
+
     # Read the file and process it
     raw_code = readCode(file)
 
@@ -114,12 +124,14 @@ def compileFile(file, options, keep=False):
     lines = toTokens(raw_code)
 
     # Moving forth to compilation
-    compiled_code = Compile(lines)
+    utils.profile = profile
+    compiled_code = Compile(lines, path.abspath(file))
 
     # cpp file
     cpp_file = file.replace(".csq", ".cpp")
 
-    final_code = bind(csq_include_path, compiled_code)
+    profile_output = path.abspath(file).replace(".csq", "") if profile else None
+    final_code = bind(csq_include_path, compiled_code, profile_output, memstats)
     name = file.replace(".csq", "")
     writeCode(final_code, cpp_file)
 
@@ -129,6 +141,69 @@ def compileFile(file, options, keep=False):
         system("rm {}".format(cpp_file))
 
 
+def findVM(csq_include_path, memstats=False):
+    """Find the Csq VM
+    The VM is built by the installer next to its sources (Core/VM/csqvm).
+    If it is missing, or older than the runtime it is built from, it gets
+    built with g++, in the include path when writable, in ~/.cache/csq otherwise.
+    With memstats the VM counting allocations (csqvm-memstats) is looked for,
+    it is only built when first needed.
+    """
+    name = "csqvm-memstats" if memstats else "csqvm"
+    vm = path.join(csq_include_path, "Core", "VM", name)
+    cached = path.join(getenv("HOME", "/tmp"), ".cache", "csq", name)
+
+    runtime = glob(path.join(csq_include_path, "Core", "*", "*.h"))
+    newest = max(path.getmtime(header) for header in runtime) if runtime else 0
+    for candidate in (vm, cached):
+        if path.exists(candidate) and path.getmtime(candidate) >= newest:
+            return candidate
+
+    if not access(path.dirname(vm), W_OK):
+        makedirs(path.dirname(cached), exist_ok=True)
+        vm = cached
+
+    source = path.join(csq_include_path, "Core", "VM", "csqvm.cpp")
+    defines = " -DCSQ_MEMSTATS" if memstats else ""
+    print("Building the Csq VM...")
+    if system("g++ -std=c++20 -O2 -pthread{} -o {} {}".format(defines, vm, source)) != 0:
+        return None
+    return vm
+
+
+def runFile(file, keep=False, memstats=False):
+    """Run the code in a file on the VM
+    The file is lowered to bytecode and executed by the Csq VM,
+    no C++ compilation is involved.
+    With memstats the allocation counters are printed on exit.
+    """
+    csq_include_path = findIncludePath()
+
+    if csq_include_path is None:
+        print("Error: csq include path not found")
+        exit(1)
+
+    vm = findVM(csq_include_path, memstats)
+    if vm is None:
+        print("Error: csq VM not found")
+        exit(1)
+
+    bytecode = Lower(readCode(file), csq_include_path)
+
+    if keep:
+        bytecode_file = file.replace(".csq", ".csqb")
+        writeBytecode(bytecode, bytecode_file)
+    else:
+        with tempfile.NamedTemporaryFile(suffix=".csqb", delete=False) as tmp:
+            tmp.write(bytecode)
+            bytecode_file = tmp.name
+
+    status = subprocess.call([vm, bytecode_file])
+    if not keep:
+        remove(bytecode_file)
+    exit(status)
+
+
 def uninstall():
     """Uninstall csq
     The function uninstalls the csq compiler
@@ -194,6 +269,24 @@ if __name__ == "__main__":
     parser.add_argument(
         "-g", "--debug", action="store_true", help="Generate debug symbols"
     )
+    parser.add_argument(
+        "-r",
+        "--run",
+        action="store_true",
+        help="Run the file on the bytecode VM instead of compiling it with g++",
+    )
+    parser.add_argument(
+        "-p",
+        "--profile",
+        action="store_true",
+        help="Instrument the program, it writes a profile report and folded stacks on exit",
+    )
+    parser.add_argument(
+        "-m",
+        "--memstats",
+        action="store_true",
+        help="Count allocations, copies and moves per type and print them on exit",
+    )
     parser.add_argument(
         "-l",
         "--leaks",
@@ -211,8 +304,14 @@ if __name__ == "__main__":
         uninstall()
         exit(0)
 
+    if args.file and args.run and isFileValid(args.file):
+        if args.profile:
+            print("Error: --profile needs the native compilation, it can't be used with --run")
+            exit(1)
+        runFile(args.file, args.keep, args.memstats)
+
     if args.file and isFileValid(args.file):
-        compiler_flags = "-std=c++17"
+        compiler_flags = "-std=c++20 -pthread"
         if args.optimize:
             try:
                 opt_level = int(args.optimize)
@@ -241,7 +340,7 @@ if __name__ == "__main__":
         else:
             compiler_flags += " -o " + args.file.replace(".csq", "")
 
-        compileFile(args.file, compiler_flags, args.keep)
+        compileFile(args.file, compiler_flags, args.keep, args.profile, args.memstats)
     else:
         printHelp()
         exit(1)